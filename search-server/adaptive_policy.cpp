@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <vector>
+
+#include "adaptive_policy.h"
+
+namespace {
+
+// Наименьшее время из нескольких прогонов: так меньше сказываются прерывания и прогрев
+template<typename Function>
+double MeasureSeconds(Function function) {
+    double best = 1e9;
+    for (int run = 0; run < 5; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Цена одного вхождения: то же накопление очков по индексам документов, что и при поиске.
+// От пути запуска задач она не зависит, поэтому замеряется один раз
+double MeasurePostingSeconds() {
+    const size_t posting_count = 1 << 16;
+    std::vector<uint32_t> document_indexes(posting_count);
+    std::vector<double> term_freqs(posting_count, 0.5);
+    std::vector<double> scores(posting_count * 2);
+    for (size_t i = 0; i < posting_count; ++i) {
+        document_indexes[i] = static_cast<uint32_t>(i * 2);
+    }
+    volatile double sink = 0;
+    return MeasureSeconds([&]() {
+        for (size_t i = 0; i < posting_count; ++i) {
+            scores[document_indexes[i]] += term_freqs[i] * 1.5;
+        }
+        sink = sink + scores[posting_count];
+    }) / posting_count;
+}
+
+} // namespace
+
+AdaptiveThresholds CalibrateAdaptiveThresholds(WorkStealingExecutor* executor) {
+    static const double posting_seconds = MeasurePostingSeconds();
+
+    // Цена запуска параллельного алгоритма с пустыми задачами тем же путём, что и у запросов
+    std::atomic<size_t> sink = 0;
+    const double dispatch_seconds = MeasureSeconds([&]() {
+        ParallelFor(executor, std::execution::par, 64, [&sink](size_t task) {
+            if (task == SIZE_MAX) {
+                sink = 0;
+            }
+        });
+    });
+
+    // Задача должна работать в несколько раз дольше, чем стоит её запуск
+    const double overhead_factor = 4;
+    return {std::max<size_t>(1, static_cast<size_t>(overhead_factor * dispatch_seconds / posting_seconds))};
+}
+
+const AdaptiveThresholds& GetAdaptiveThresholds() {
+    static const AdaptiveThresholds thresholds = CalibrateAdaptiveThresholds(nullptr);
+    return thresholds;
+}
+
+size_t ChooseParallelism(size_t work, size_t max_parallelism, const AdaptiveThresholds& thresholds) {
+    return std::clamp<size_t>(work / thresholds.min_task_work, 1, std::max<size_t>(1, max_parallelism));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+#include "work_stealing_executor.h"
+
+// Политика выполнения для FindTopDocuments и MatchDocument: сервер сам выбирает последовательное
+// или параллельное выполнение и число задач по оценке работы запроса
+struct AdaptivePolicy {};
+
+inline constexpr AdaptivePolicy adaptive_execution{};
+
+// Пороги выбора, измеренные микробенчмарком
+struct AdaptiveThresholds {
+    // Наименьшая работа на параллельную задачу, в вхождениях списков: меньше её запуск задачи дороже выигрыша
+    size_t min_task_work;
+};
+
+// Замеряет пороги для того пути, которым пойдут параллельные задачи: executor или, если он nullptr,
+// std::execution::par. Занимает порядка миллисекунды, поэтому вызывается при настройке, а не на запросе
+AdaptiveThresholds CalibrateAdaptiveThresholds(WorkStealingExecutor* executor);
+
+// Пороги для std::execution::par, замеренные один раз за процесс при первом обращении.
+// Вызов при старте избавляет от замера первый запрос
+const AdaptiveThresholds& GetAdaptiveThresholds();
+
+// Сколько параллельных задач выделить на work вхождений при max_parallelism потоках; 1 — выполнять последовательно
+size_t ChooseParallelism(size_t work, size_t max_parallelism,
+                         const AdaptiveThresholds& thresholds = GetAdaptiveThresholds());
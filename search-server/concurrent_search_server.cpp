@@ -0,0 +1,73 @@
+#include <functional>
+#include <thread>
+
+#include "concurrent_search_server.h"
+
+namespace {
+
+size_t GetReaderSlot(size_t slot_count) {
+    thread_local const size_t slot = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return slot % slot_count;
+}
+
+} // namespace
+
+ConcurrentSearchServer::ReadAccess::ReadAccess(const SearchServer& server, std::atomic<int64_t>& reader_count)
+        : server_(server), reader_count_(reader_count) {
+}
+
+ConcurrentSearchServer::ReadAccess::~ReadAccess() {
+    // Будить есть кого, только когда счётчик опустел: писатель ждёт именно нуля
+    if (reader_count_.fetch_sub(1) == 1) {
+        reader_count_.notify_all();
+    }
+}
+
+ConcurrentSearchServer ConcurrentSearchServer::OpenSnapshot(const std::string& path, bool verify_checksum) {
+    return {SearchServer::OpenSnapshot(path, verify_checksum), SearchServer::OpenSnapshot(path, false)};
+}
+
+ConcurrentSearchServer::ReadAccess ConcurrentSearchServer::Read() const {
+    // Читатель отмечается раньше, чем узнаёт опубликованную копию: писатель, увидев метку,
+    // не тронет ни одну из копий, которую этот читатель может выбрать
+    std::atomic<int64_t>& reader_count = reader_counts_[reader_version_.load()][GetReaderSlot(READER_SLOT_COUNT)].value;
+    reader_count.fetch_add(1);
+    return {servers_[published_.load()], reader_count};
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                                         const std::vector<int>& ratings) {
+    Write([&](SearchServer& server) {
+        server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Write([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+    });
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return Read()->GetDocumentCount();
+}
+
+ConcurrentSearchServer::ConcurrentSearchServer(SearchServer first, SearchServer second)
+        : servers_{std::move(first), std::move(second)} {
+}
+
+void ConcurrentSearchServer::WaitForReaders() {
+    const auto wait_for_empty = [this](size_t version) {
+        for (const ReaderCount& reader_count : reader_counts_[version]) {
+            for (int64_t count = reader_count.value.load(); count != 0; count = reader_count.value.load()) {
+                reader_count.value.wait(count);
+            }
+        }
+    };
+    // Сначала уходят читатели нового набора, затем новые читатели переводятся в него и уходят читатели старого.
+    // После этого старой копией не пользуется никто
+    const size_t version = reader_version_.load();
+    wait_for_empty(1 - version);
+    reader_version_.store(1 - version);
+    wait_for_empty(version);
+}
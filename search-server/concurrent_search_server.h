@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// SearchServer для одновременных чтения и записи (схема Left-Right).
+// Индекс хранится в двух копиях: читатели работают с опубликованной, писатель меняет вторую,
+// атомарно публикует её и, дождавшись ухода читателей со старой копии, повторяет на ней то же изменение.
+// Чтение не берёт блокировок и не ждёт писателя: вход и выход — по одному атомарному счётчику.
+// Писатели выполняются по одному. Памяти нужно вдвое больше, кроме частей, открытых из одного снимка
+class ConcurrentSearchServer {
+public:
+    // Доступ к опубликованной копии. Пока он жив, эта копия не меняется, поэтому все запросы
+    // через один доступ видят одно состояние индекса
+    class ReadAccess {
+    public:
+        ReadAccess(const ReadAccess&) = delete;
+
+        ReadAccess& operator=(const ReadAccess&) = delete;
+
+        ~ReadAccess();
+
+        const SearchServer& operator*() const {
+            return server_;
+        }
+
+        const SearchServer* operator->() const {
+            return &server_;
+        }
+
+    private:
+        friend class ConcurrentSearchServer;
+
+        ReadAccess(const SearchServer& server, std::atomic<int64_t>& reader_count);
+
+        const SearchServer& server_;
+        std::atomic<int64_t>& reader_count_;
+    };
+
+    template<typename StopWords>
+    explicit ConcurrentSearchServer(const StopWords& stop_words)
+            : servers_{SearchServer(stop_words), SearchServer(stop_words)} {
+    }
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    // Обе копии отображают один файл, так что списки вхождений в памяти не удваиваются
+    static ConcurrentSearchServer OpenSnapshot(const std::string& path, bool verify_checksum = true);
+
+    ReadAccess Read() const;
+
+    // Применяет function(SearchServer&) к обеим копиям по очереди. Если она бросает исключение на первой копии,
+    // ничего не публикуется. Второй вызов обязан не бросать: function должна быть детерминированной, чтобы
+    // повторить первый вызов в точности, а исключение на второй копии (на деле только bad_alloc) оставило бы
+    // её наполовину изменённой. Восстановить её из первой нельзя, SearchServer не копируется, поэтому такое
+    // исключение завершает программу. Поток, который держит ReadAccess, писать не может: писатель ждал бы его ухода
+    template<typename Function>
+    void Write(Function function);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                     const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    template<typename... Args>
+    std::vector<Document> FindTopDocuments(const Args&... args) const {
+        return Read()->FindTopDocuments(args...);
+    }
+
+    int GetDocumentCount() const;
+
+private:
+    // Счётчики читателей разнесены по кэш-линиям и по потокам, чтобы читатели не делили одну ячейку
+    struct alignas(64) ReaderCount {
+        std::atomic<int64_t> value = 0;
+    };
+
+    static constexpr size_t READER_SLOT_COUNT = 32;
+
+    std::array<SearchServer, 2> servers_;
+    // Копия, которую видят новые читатели
+    std::atomic<size_t> published_ = 0;
+    // Набор счётчиков, в котором отмечаются новые читатели
+    std::atomic<size_t> reader_version_ = 0;
+    mutable ReaderCount reader_counts_[2][READER_SLOT_COUNT];
+    std::mutex write_mutex_;
+
+    ConcurrentSearchServer(SearchServer first, SearchServer second);
+
+    // Дожидается ухода всех читателей, которые могли застать копию до публикации
+    void WaitForReaders();
+};
+
+template<typename Function>
+void ConcurrentSearchServer::Write(Function function) {
+    std::lock_guard guard(write_mutex_);
+    const size_t published = published_.load();
+    function(servers_[1 - published]);
+    published_.store(1 - published);
+    WaitForReaders();
+    [&]() noexcept {
+        function(servers_[published]);
+    }();
+}
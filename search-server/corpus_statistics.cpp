@@ -0,0 +1,42 @@
+#include "corpus_statistics.h"
+
+void CorpusStatistics::AddDocument(const std::map<std::string_view, double>& word_freqs) {
+    for (const auto& [word, term_freq] : word_freqs) {
+        const auto [it, inserted] = word_ids_.emplace(word, document_frequencies_.size());
+        if (inserted) {
+            document_frequencies_.push_back(0);
+        }
+        ++document_frequencies_[it->second];
+    }
+    ++document_count_;
+    ++epoch_;
+}
+
+void CorpusStatistics::RemoveDocument(const std::map<std::string_view, double>& word_freqs) {
+    for (const auto& [word, term_freq] : word_freqs) {
+        --document_frequencies_[word_ids_.at(word)];
+    }
+    --document_count_;
+    ++epoch_;
+}
+
+size_t CorpusStatistics::GetDocumentCount() const {
+    return document_count_;
+}
+
+size_t CorpusStatistics::FindWord(std::string_view word) const {
+    const auto it = word_ids_.find(word);
+    return it == word_ids_.end() ? NO_WORD : it->second;
+}
+
+size_t CorpusStatistics::GetDocumentFrequency(std::string_view word) const {
+    return GetDocumentFrequency(FindWord(word));
+}
+
+size_t CorpusStatistics::GetDocumentFrequency(size_t word_id) const {
+    return word_id < document_frequencies_.size() ? document_frequencies_[word_id] : 0;
+}
+
+uint64_t CorpusStatistics::GetEpoch() const {
+    return epoch_;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Число документов и документная частота слов сразу по нескольким индексам.
+// Индексы, которым она передана через SearchServer::SetCorpusStatistics, считают IDF по ней,
+// поэтому релевантность в каждом из них та же, что в одном общем индексе.
+// Синхронизации внутри нет: статистику меняют только при внешнем исключении, как и сами индексы,
+// и не одновременно с поиском в них
+class CorpusStatistics {
+public:
+    static constexpr size_t NO_WORD = std::numeric_limits<size_t>::max();
+
+    // Слова запоминаются как string_view и должны жить дольше статистики
+    void AddDocument(const std::map<std::string_view, double>& word_freqs);
+
+    void RemoveDocument(const std::map<std::string_view, double>& word_freqs);
+
+    size_t GetDocumentCount() const;
+
+    // Номер слова не меняется, пока жива статистика, даже если слово пропало из всех документов; NO_WORD, если слова нет
+    size_t FindWord(std::string_view word) const;
+
+    size_t GetDocumentFrequency(std::string_view word) const;
+
+    // Частота по номеру из FindWord, без поиска по строке
+    size_t GetDocumentFrequency(size_t word_id) const;
+
+    // Меняется при каждом изменении статистики и делает недействительными посчитанные по ней IDF
+    uint64_t GetEpoch() const;
+
+private:
+    size_t document_count_ = 0;
+    uint64_t epoch_ = 0;
+    std::unordered_map<std::string_view, size_t> word_ids_;
+    std::vector<size_t> document_frequencies_;
+};
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+#include "index_segment.h"
+
+IndexSegment::IndexSegment(uint32_t first_document_index)
+        : first_document_index_(first_document_index), end_document_index_(first_document_index) {
+}
+
+IndexSegment::IndexSegment(uint32_t first_document_index, uint32_t end_document_index, size_t document_count,
+                           std::vector<uint32_t> term_ids, std::vector<PostingList> postings)
+        : first_document_index_(first_document_index), end_document_index_(end_document_index),
+          document_count_(document_count), sealed_(true), term_ids_(std::move(term_ids)),
+          postings_(std::move(postings)) {
+}
+
+const PostingList* IndexSegment::FindPostings(uint32_t term_id) const {
+    if (!sealed_) {
+        const auto it = positions_.find(term_id);
+        return it == positions_.end() ? nullptr : &postings_[it->second];
+    }
+    const auto it = std::lower_bound(term_ids_.begin(), term_ids_.end(), term_id);
+    return it == term_ids_.end() || *it != term_id ? nullptr : &postings_[it - term_ids_.begin()];
+}
+
+PostingList& IndexSegment::GetPostings(uint32_t term_id) {
+    const auto [it, inserted] = positions_.try_emplace(term_id, static_cast<uint32_t>(postings_.size()));
+    if (inserted) {
+        term_ids_.push_back(term_id);
+        postings_.emplace_back();
+    }
+    return postings_[it->second];
+}
+
+void IndexSegment::AddDocuments(size_t document_count) {
+    end_document_index_ += static_cast<uint32_t>(document_count);
+    document_count_ += document_count;
+}
+
+void IndexSegment::MarkRemoved(size_t document_count) {
+    removed_document_count_ += document_count;
+}
+
+void IndexSegment::Seal(bool compress, WorkStealingExecutor* executor) {
+    std::vector<uint32_t> order(term_ids_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+        return term_ids_[lhs] < term_ids_[rhs];
+    });
+    std::vector<uint32_t> term_ids;
+    std::vector<PostingList> postings;
+    term_ids.reserve(order.size());
+    postings.reserve(order.size());
+    for (const uint32_t position : order) {
+        term_ids.push_back(term_ids_[position]);
+        postings.push_back(std::move(postings_[position]));
+    }
+    term_ids_ = std::move(term_ids);
+    postings_ = std::move(postings);
+    positions_ = {};
+    sealed_ = true;
+    SetCompression(compress, executor);
+}
+
+void IndexSegment::SetCompression(bool enabled, WorkStealingExecutor* executor) {
+    ParallelFor(executor, std::execution::par, postings_.size(), [this, enabled](size_t position) {
+        if (enabled) {
+            postings_[position].Compress();
+        } else {
+            postings_[position].Decompress();
+        }
+    });
+}
+
+IndexSegment IndexSegment::Merge(std::span<const IndexSegment* const> segments, const std::vector<bool>& removed,
+                                 size_t document_count, bool compress) {
+    const uint32_t first_document_index = segments.front()->first_document_index_;
+    std::vector<uint32_t> all_term_ids;
+    for (const IndexSegment* segment : segments) {
+        all_term_ids.insert(all_term_ids.end(), segment->term_ids_.begin(), segment->term_ids_.end());
+    }
+    std::sort(all_term_ids.begin(), all_term_ids.end());
+    all_term_ids.erase(std::unique(all_term_ids.begin(), all_term_ids.end()), all_term_ids.end());
+
+    std::vector<uint32_t> term_ids;
+    std::vector<PostingList> postings;
+    std::vector<const PostingList*> lists;
+    for (const uint32_t term_id : all_term_ids) {
+        lists.clear();
+        for (const IndexSegment* segment : segments) {
+            if (const PostingList* segment_postings = segment->FindPostings(term_id)) {
+                lists.push_back(segment_postings);
+            }
+        }
+        PostingList merged = MergePostings(lists, removed, first_document_index, compress);
+        // Терм, который остался только в удалённых документах, в новый сегмент не попадает
+        if (!merged.empty()) {
+            term_ids.push_back(term_id);
+            postings.push_back(std::move(merged));
+        }
+    }
+    return {first_document_index, segments.back()->end_document_index_, document_count, std::move(term_ids),
+            std::move(postings)};
+}
+
+PostingList IndexSegment::MergePostings(std::span<const PostingList* const> lists, const std::vector<bool>& removed,
+                                        uint32_t first_document_index, bool compress) {
+    PostingList merged;
+    for (const PostingList* postings : lists) {
+        for (auto block = postings->Blocks(); !block.AtEnd(); block.Next()) {
+            for (size_t i = 0; i < block.size(); ++i) {
+                const uint32_t document_index = block.DocumentIndexes()[i];
+                if (!removed[document_index - first_document_index]) {
+                    merged.Add(document_index, block.TermFreqs()[i]);
+                }
+            }
+        }
+    }
+    if (compress) {
+        merged.Compress();
+    }
+    return merged;
+}
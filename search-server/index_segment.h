@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "posting_list.h"
+#include "work_stealing_executor.h"
+
+// Часть индекса: списки вхождений документов с индексами [FirstDocumentIndex(), EndDocumentIndex()).
+// Пока сегмент не запечатан, в него дописываются новые документы; запечатанный больше не меняется
+// и может хранить списки в сжатом виде. Удалённые документы в запечатанном сегменте остаются
+// в списках, пока он не будет слит с соседями (Merge), а учитывает их только счётчик
+class IndexSegment {
+public:
+    explicit IndexSegment(uint32_t first_document_index);
+
+    // Запечатанный сегмент из готовых списков; term_ids строго возрастают
+    IndexSegment(uint32_t first_document_index, uint32_t end_document_index, size_t document_count,
+                 std::vector<uint32_t> term_ids, std::vector<PostingList> postings);
+
+    uint32_t FirstDocumentIndex() const {
+        return first_document_index_;
+    }
+
+    uint32_t EndDocumentIndex() const {
+        return end_document_index_;
+    }
+
+    // Документы, вхождения которых лежат в сегменте, включая удалённые после его построения
+    size_t GetDocumentCount() const {
+        return document_count_;
+    }
+
+    size_t GetRemovedDocumentCount() const {
+        return removed_document_count_;
+    }
+
+    size_t GetLiveDocumentCount() const {
+        return document_count_ - removed_document_count_;
+    }
+
+    bool IsSealed() const {
+        return sealed_;
+    }
+
+    // nullptr, если терма в сегменте нет
+    const PostingList* FindPostings(uint32_t term_id) const;
+
+    // Список терма в незапечатанном сегменте, создаётся при первом обращении.
+    // Ссылки на списки остаются верными только до создания следующего
+    PostingList& GetPostings(uint32_t term_id);
+
+    // Расширяет диапазон на document_count документов, добавленных в конец
+    void AddDocuments(size_t document_count);
+
+    void MarkRemoved(size_t document_count);
+
+    // Упорядочивает списки по id терма и больше не принимает документов
+    void Seal(bool compress, WorkStealingExecutor* executor);
+
+    // Списки сжимаются параллельно на executor, если он задан, иначе через std::execution::par
+    void SetCompression(bool enabled, WorkStealingExecutor* executor);
+
+    size_t GetTermCount() const {
+        return term_ids_.size();
+    }
+
+    uint32_t GetTermId(size_t position) const {
+        return term_ids_[position];
+    }
+
+    const PostingList& GetPostingsAt(size_t position) const {
+        return postings_[position];
+    }
+
+    // Сливает соседние запечатанные сегменты в один, выбрасывая документы, помеченные в removed.
+    // removed адресуется индексом документа минус FirstDocumentIndex() первого сегмента,
+    // document_count — сколько документов останется в новом сегменте
+    static IndexSegment Merge(std::span<const IndexSegment* const> segments, const std::vector<bool>& removed,
+                              size_t document_count, bool compress);
+
+    // Вхождения lists подряд, без документов, для которых removed[индекс - first_document_index] истинно.
+    // Списки должны идти по возрастанию индексов документов
+    static PostingList MergePostings(std::span<const PostingList* const> lists, const std::vector<bool>& removed,
+                                     uint32_t first_document_index, bool compress);
+
+private:
+    uint32_t first_document_index_;
+    uint32_t end_document_index_;
+    size_t document_count_ = 0;
+    size_t removed_document_count_ = 0;
+    bool sealed_ = false;
+    // У запечатанного сегмента term_ids_ возрастают и поиск идёт двоичный, у изменяемого — через positions_
+    std::vector<uint32_t> term_ids_;
+    std::vector<PostingList> postings_;
+    std::unordered_map<uint32_t, uint32_t> positions_;
+};
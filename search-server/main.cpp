@@ -1,5 +1,6 @@
 #include "search_server.h"
 #include "log_duration.h"
+#include "process_queries.h"
 #include "test_example_functions.h"
 
 #include <execution>
@@ -53,11 +54,30 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
-template <typename ExecutionPolicy>
-void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
+// Слова выбираются по закону Ципфа, как в обычных текстах: запросы смешивают частые слова с редкими
+vector<string> GenerateZipfTexts(mt19937& generator, const vector<string>& dictionary, int text_count, int word_count) {
+    vector<double> weights(dictionary.size());
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    discrete_distribution<size_t> word_distribution(weights.begin(), weights.end());
+    vector<string> texts(text_count);
+    for (string& text : texts) {
+        for (int i = 0; i < word_count; ++i) {
+            if (!text.empty()) {
+                text.push_back(' ');
+            }
+            text += dictionary[word_distribution(generator)];
+        }
+    }
+    return texts;
+}
+
+template <typename Query, typename ExecutionPolicy>
+void Test(string_view mark, const SearchServer& search_server, const vector<Query>& queries, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
     double total_relevance = 0;
-    for (const string_view query : queries) {
+    for (const auto& query : queries) {
         for (const auto& document : search_server.FindTopDocuments(policy, query)) {
             total_relevance += document.relevance;
         }
@@ -65,6 +85,19 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 
+template <typename Process>
+void TestProcessing(string_view mark, const SearchServer& search_server, const vector<string>& queries,
+                    Process process) {
+    LOG_DURATION(mark);
+    double total_relevance = 0;
+    for (const auto& documents : process(search_server, queries)) {
+        for (const auto& document : documents) {
+            total_relevance += document.relevance;
+        }
+    }
+    cout << total_relevance << endl;
+}
+
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
 int main() {
@@ -83,5 +116,42 @@ int main() {
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
 
     TEST(seq);
+    vector<SearchServer::PreparedQuery> prepared_queries;
+    for (const string& query : queries) {
+        prepared_queries.push_back(search_server.PrepareQuery(query));
+    }
+    Test("seq prepared"sv, search_server, prepared_queries, execution::seq);
     TEST(par);
+    Test("adaptive"sv, search_server, queries, adaptive_execution);
+
+    search_server.SetParallelSplit(ParallelSplit::BY_TERM);
+    Test("par by term"sv, search_server, queries, execution::par);
+    search_server.SetParallelSplit(ParallelSplit::BY_DOCUMENT_RANGE);
+
+    search_server.SetExecutor(make_shared<WorkStealingExecutor>());
+    Test("par on executor"sv, search_server, queries, execution::par);
+    search_server.SetExecutor(nullptr);
+
+    TestProcessing("process queries"sv, search_server, queries, ProcessQueries);
+    TestProcessing("process queries batched"sv, search_server, queries, ProcessQueriesBatched);
+
+    search_server.SetRetrievalMode(RetrievalMode::MAX_SCORE);
+    Test("seq max score"sv, search_server, queries, execution::seq);
+
+    search_server.SetRetrievalMode(RetrievalMode::BLOCK_MAX_SCORE);
+    Test("seq block max score"sv, search_server, queries, execution::seq);
+
+    // На равномерном словаре выше отсекать нечего, а здесь частые слова запроса не могут вывести документ в выдачу
+    const auto zipf_dictionary = GenerateDictionary(generator, 20'000, 10);
+    const auto zipf_documents = GenerateZipfTexts(generator, zipf_dictionary, 50'000, 30);
+    SearchServer zipf_server(""s);
+    for (size_t i = 0; i < zipf_documents.size(); ++i) {
+        zipf_server.AddDocument(i, zipf_documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    const auto zipf_queries = GenerateZipfTexts(generator, zipf_dictionary, 200, 4);
+    Test("zipf seq"sv, zipf_server, zipf_queries, execution::seq);
+    zipf_server.SetRetrievalMode(RetrievalMode::MAX_SCORE);
+    Test("zipf seq max score"sv, zipf_server, zipf_queries, execution::seq);
+    zipf_server.SetRetrievalMode(RetrievalMode::BLOCK_MAX_SCORE);
+    Test("zipf seq block max score"sv, zipf_server, zipf_queries, execution::seq);
 }
\ No newline at end of file
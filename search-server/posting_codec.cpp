@@ -0,0 +1,187 @@
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POSTING_CODEC_X86
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "posting_codec.h"
+
+namespace {
+
+uint32_t BitMask(uint32_t bit_width) {
+    return bit_width >= 32 ? ~0u : (1u << bit_width) - 1;
+}
+
+size_t PositionCount(size_t count) {
+    return (count + POSTING_BLOCK_LANES - 1) / POSTING_BLOCK_LANES;
+}
+
+void UnpackScalar(const uint32_t* in, size_t positions, uint32_t bit_width, uint32_t* values) {
+    const uint32_t mask = BitMask(bit_width);
+    for (size_t position = 0; position < positions; ++position) {
+        const size_t bit = position * bit_width;
+        const size_t word = bit / 32;
+        const uint32_t offset = bit % 32;
+        for (size_t lane = 0; lane < POSTING_BLOCK_LANES; ++lane) {
+            uint32_t value = in[word * POSTING_BLOCK_LANES + lane] >> offset;
+            if (offset + bit_width > 32) {
+                value |= in[(word + 1) * POSTING_BLOCK_LANES + lane] << (32 - offset);
+            }
+            values[position * POSTING_BLOCK_LANES + lane] = value & mask;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+void UnpackSse2(const uint32_t* in, size_t positions, uint32_t bit_width, uint32_t* values) {
+    const __m128i mask_v = _mm_set1_epi32(static_cast<int>(BitMask(bit_width)));
+    for (size_t position = 0; position < positions; ++position) {
+        const size_t bit = position * bit_width;
+        const uint32_t* word = in + bit / 32 * POSTING_BLOCK_LANES;
+        const int offset = static_cast<int>(bit % 32);
+        const __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word));
+        const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word + POSTING_BLOCK_LANES));
+        const __m128i value = _mm_or_si128(_mm_srl_epi32(current, _mm_cvtsi32_si128(offset)),
+                                           _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - offset)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + position * POSTING_BLOCK_LANES),
+                         _mm_and_si128(value, mask_v));
+    }
+}
+#endif
+
+#if defined(POSTING_CODEC_X86)
+// Собирается с AVX2 независимо от флагов сборки и вызывается, только если процессор его поддерживает.
+// Две позиции за итерацию: младшая половина регистра — позиция p, старшая — p + 1.
+// Сдвиги на 32 и больше дают ноль, поэтому перенос из следующего слова не требует ветвления
+__attribute__((target("avx2")))
+void UnpackAvx2(const uint32_t* in, size_t positions, uint32_t bit_width, uint32_t* values) {
+    const __m256i mask_v = _mm256_set1_epi32(static_cast<int>(BitMask(bit_width)));
+    const __m256i full_v = _mm256_set1_epi32(32);
+    for (size_t position = 0; position < positions; position += 2) {
+        const size_t bit_lo = position * bit_width;
+        const size_t bit_hi = bit_lo + bit_width;
+        const uint32_t* word_lo = in + bit_lo / 32 * POSTING_BLOCK_LANES;
+        const uint32_t* word_hi = in + bit_hi / 32 * POSTING_BLOCK_LANES;
+        const __m256i current = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(word_lo))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(word_hi)), 1);
+        const __m256i next = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(word_lo + POSTING_BLOCK_LANES))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(word_hi + POSTING_BLOCK_LANES)), 1);
+        const int offset_lo = static_cast<int>(bit_lo % 32);
+        const int offset_hi = static_cast<int>(bit_hi % 32);
+        const __m256i shift = _mm256_setr_epi32(offset_lo, offset_lo, offset_lo, offset_lo,
+                                                offset_hi, offset_hi, offset_hi, offset_hi);
+        const __m256i value = _mm256_or_si256(_mm256_srlv_epi32(current, shift),
+                                              _mm256_sllv_epi32(next, _mm256_sub_epi32(full_v, shift)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + position * POSTING_BLOCK_LANES),
+                            _mm256_and_si256(value, mask_v));
+    }
+}
+#endif
+
+} // namespace
+
+uint32_t RequiredBitWidth(const uint32_t* values, size_t count) {
+    uint32_t all_bits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        all_bits |= values[i];
+    }
+    uint32_t bit_width = 0;
+    while (bit_width < 32 && (all_bits >> bit_width) != 0) {
+        ++bit_width;
+    }
+    return bit_width;
+}
+
+size_t PackedBlockWords(size_t count, uint32_t bit_width) {
+    return POSTING_BLOCK_LANES * ((PositionCount(count) * bit_width + 31) / 32);
+}
+
+void PackBlock(const uint32_t* values, size_t count, uint32_t bit_width, uint32_t* out) {
+    std::fill(out, out + PackedBlockWords(count, bit_width), 0u);
+    if (bit_width == 0) {
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const size_t lane = i % POSTING_BLOCK_LANES;
+        const size_t bit = (i / POSTING_BLOCK_LANES) * bit_width;
+        const size_t word = bit / 32;
+        const uint32_t offset = bit % 32;
+        out[word * POSTING_BLOCK_LANES + lane] |= values[i] << offset;
+        if (offset + bit_width > 32) {
+            out[(word + 1) * POSTING_BLOCK_LANES + lane] |= values[i] >> (32 - offset);
+        }
+    }
+}
+
+void UnpackBlock(const uint32_t* in, size_t count, uint32_t bit_width, uint32_t* values) {
+    // Ядро выбирается один раз, по процессору, на котором запущена программа
+    static const UnpackKernel kernel = IsUnpackKernelSupported(UnpackKernel::AVX2) ? UnpackKernel::AVX2
+            : IsUnpackKernelSupported(UnpackKernel::SSE2) ? UnpackKernel::SSE2 : UnpackKernel::SCALAR;
+    UnpackBlock(kernel, in, count, bit_width, values);
+}
+
+bool IsUnpackKernelSupported(UnpackKernel kernel) {
+    switch (kernel) {
+        case UnpackKernel::SCALAR:
+            return true;
+        case UnpackKernel::SSE2:
+#if defined(__SSE2__)
+            return true;
+#else
+            return false;
+#endif
+        case UnpackKernel::AVX2:
+#if defined(POSTING_CODEC_X86)
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+void UnpackBlock(UnpackKernel kernel, const uint32_t* in, size_t count, uint32_t bit_width, uint32_t* values) {
+    const size_t positions = PositionCount(count);
+    if (bit_width == 0) {
+        std::fill(values, values + positions * POSTING_BLOCK_LANES, 0u);
+        return;
+    }
+    switch (kernel) {
+#if defined(POSTING_CODEC_X86)
+        case UnpackKernel::AVX2:
+            UnpackAvx2(in, positions, bit_width, values);
+            return;
+#endif
+#if defined(__SSE2__)
+        case UnpackKernel::SSE2:
+            UnpackSse2(in, positions, bit_width, values);
+            return;
+#endif
+        default:
+            UnpackScalar(in, positions, bit_width, values);
+    }
+}
+
+void PrefixSum(uint32_t* values, size_t count, uint32_t base) {
+#if defined(__SSE2__)
+    __m128i running = _mm_set1_epi32(static_cast<int>(base));
+    for (size_t i = 0; i < PositionCount(count) * POSTING_BLOCK_LANES; i += POSTING_BLOCK_LANES) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+        value = _mm_add_epi32(value, running);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), value);
+        running = _mm_shuffle_epi32(value, 0xFF);
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        base += values[i];
+        values[i] = base;
+    }
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Блок сжатого списка вхождений: до 128 чисел по bit_width бит, разложенных по 4 чередующимся
+// 32-битным лейнам (i-е число лежит в лейне i % 4). Такая раскладка распаковывается SSE-регистром
+// по 4 числа за инструкцию, а AVX2 — по 8
+inline constexpr size_t POSTING_BLOCK_SIZE = 128;
+inline constexpr size_t POSTING_BLOCK_LANES = 4;
+// Распаковщик читает за концом последнего блока, поэтому упакованные данные дополняются нулями
+inline constexpr size_t POSTING_BLOCK_PADDING = 8;
+
+uint32_t RequiredBitWidth(const uint32_t* values, size_t count);
+
+size_t PackedBlockWords(size_t count, uint32_t bit_width);
+
+// out должен вмещать PackedBlockWords(count, bit_width) слов
+void PackBlock(const uint32_t* values, size_t count, uint32_t bit_width, uint32_t* out);
+
+// values должен вмещать POSTING_BLOCK_SIZE чисел: распаковка идёт целыми SIMD-регистрами
+void UnpackBlock(const uint32_t* in, size_t count, uint32_t bit_width, uint32_t* values);
+
+// Реализации UnpackBlock. Обычная UnpackBlock выбирает самую быструю из поддерживаемых процессором:
+// AVX2 собирается всегда, когда это позволяет компилятор, а не только при -mavx2
+enum class UnpackKernel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+bool IsUnpackKernelSupported(UnpackKernel kernel);
+
+void UnpackBlock(UnpackKernel kernel, const uint32_t* in, size_t count, uint32_t bit_width, uint32_t* values);
+
+// Восстанавливает числа из разностей: values[i] = base + values[0] + ... + values[i]
+void PrefixSum(uint32_t* values, size_t count, uint32_t base);
@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <cmath>
+
+#include "posting_list.h"
+
+namespace {
+
+const double FREQ_QUANTUM = 1.0 / 65535;
+
+// TF лежит в (0, 1], поэтому 16-битная фиксированная точка даёт погрешность не больше 1e-5
+uint16_t QuantizeFreq(double term_freq) {
+    return static_cast<uint16_t>(std::clamp(std::lround(term_freq / FREQ_QUANTUM), 1l, 65535l));
+}
+
+template<typename T>
+std::vector<T> ToVector(std::span<const T> values) {
+    return {values.begin(), values.end()};
+}
+
+} // namespace
+
+PostingList::PostingList(const PostingList& other)
+        : view_(other.view_), mapped_(other.mapped_), document_indexes_(other.document_indexes_),
+          term_freqs_(other.term_freqs_), compressed_(other.compressed_), blocks_(other.blocks_),
+          packed_(other.packed_), quantized_freqs_(other.quantized_freqs_), max_term_freq_(other.max_term_freq_),
+          block_max_freqs_(other.block_max_freqs_) {
+    if (!mapped_) {
+        UpdateView();
+    }
+}
+
+PostingList& PostingList::operator=(const PostingList& other) {
+    if (this != &other) {
+        PostingList copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+void PostingList::Add(uint32_t document_index, double term_freq) {
+    Detach();
+    if (compressed_) {
+        AddCompressed(document_index, term_freq);
+    } else {
+        AddFlat(document_index, term_freq);
+    }
+    UpdateView();
+}
+
+bool PostingList::Remove(uint32_t document_index) {
+    if (compressed_) {
+        if (!Contains(document_index)) {
+            return false;
+        }
+        Decompress();
+        Remove(document_index);
+        Compress();
+        return true;
+    }
+    Detach();
+    const auto it = std::lower_bound(document_indexes_.begin(), document_indexes_.end(), document_index);
+    if (it == document_indexes_.end() || *it != document_index) {
+        return false;
+    }
+    const auto offset = it - document_indexes_.begin();
+    const bool was_max = term_freqs_[offset] >= max_term_freq_;
+    term_freqs_.erase(term_freqs_.begin() + offset);
+    document_indexes_.erase(it);
+    UpdateBlockMaxFreqs(offset / POSTING_BLOCK_SIZE);
+    if (was_max) {
+        UpdateMaxTermFreq();
+    }
+    UpdateView();
+    return true;
+}
+
+bool PostingList::Contains(uint32_t document_index) const {
+    if (!compressed_) {
+        return std::binary_search(view_.document_indexes.begin(), view_.document_indexes.end(), document_index);
+    }
+    BlockIterator block = Blocks();
+    block.SkipTo(document_index);
+    if (block.AtEnd()) {
+        return false;
+    }
+    return std::binary_search(block.DocumentIndexes(), block.DocumentIndexes() + block.size(), document_index);
+}
+
+size_t PostingList::size() const {
+    return compressed_ ? view_.quantized_freqs.size() : view_.document_indexes.size();
+}
+
+bool PostingList::empty() const {
+    return size() == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+double PostingList::GetBlockMaxTermFreq(size_t block) const {
+    return view_.block_max_freqs[block];
+}
+
+PostingList::BlockIterator PostingList::Blocks() const {
+    return BlockIterator(*this);
+}
+
+PostingList::Cursor PostingList::Begin() const {
+    return Cursor(*this);
+}
+
+void PostingList::Compress() {
+    if (compressed_) {
+        return;
+    }
+    Detach();
+    compressed_ = true;
+    quantized_freqs_.reserve(term_freqs_.size());
+    for (const double term_freq : term_freqs_) {
+        quantized_freqs_.push_back(QuantizeFreq(term_freq));
+    }
+    for (size_t first = 0; first < document_indexes_.size(); first += POSTING_BLOCK_SIZE) {
+        AppendBlock(document_indexes_.data() + first, std::min(POSTING_BLOCK_SIZE, document_indexes_.size() - first));
+    }
+    document_indexes_.clear();
+    document_indexes_.shrink_to_fit();
+    term_freqs_.clear();
+    term_freqs_.shrink_to_fit();
+    UpdateBlockMaxFreqs(0);
+    UpdateMaxTermFreq();
+    UpdateView();
+}
+
+void PostingList::Decompress() {
+    if (!compressed_) {
+        return;
+    }
+    std::vector<uint32_t> document_indexes;
+    std::vector<double> term_freqs;
+    document_indexes.reserve(size());
+    term_freqs.reserve(size());
+    for (BlockIterator block = Blocks(); !block.AtEnd(); block.Next()) {
+        document_indexes.insert(document_indexes.end(), block.DocumentIndexes(), block.DocumentIndexes() + block.size());
+        term_freqs.insert(term_freqs.end(), block.TermFreqs(), block.TermFreqs() + block.size());
+    }
+    mapped_ = false;
+    compressed_ = false;
+    blocks_ = {};
+    packed_ = {};
+    quantized_freqs_ = {};
+    document_indexes_ = std::move(document_indexes);
+    term_freqs_ = std::move(term_freqs);
+    UpdateBlockMaxFreqs(0);
+    UpdateMaxTermFreq();
+    UpdateView();
+}
+
+bool PostingList::IsCompressed() const {
+    return compressed_;
+}
+
+void PostingList::Save(SnapshotWriter& writer) const {
+    writer.WriteValue<uint64_t>(compressed_);
+    writer.WriteValue(max_term_freq_);
+    writer.WriteArray(view_.document_indexes);
+    writer.WriteArray(view_.term_freqs);
+    writer.WriteArray(view_.blocks);
+    writer.WriteArray(view_.packed);
+    writer.WriteArray(view_.quantized_freqs);
+    writer.WriteArray(view_.block_max_freqs);
+}
+
+PostingList PostingList::Map(SnapshotReader& reader) {
+    PostingList postings;
+    postings.mapped_ = true;
+    postings.compressed_ = reader.ReadValue<uint64_t>() != 0;
+    postings.max_term_freq_ = reader.ReadValue<double>();
+    postings.view_.document_indexes = reader.ReadArray<uint32_t>();
+    postings.view_.term_freqs = reader.ReadArray<double>();
+    postings.view_.blocks = reader.ReadArray<Block>();
+    postings.view_.packed = reader.ReadArray<uint32_t>();
+    postings.view_.quantized_freqs = reader.ReadArray<uint16_t>();
+    postings.view_.block_max_freqs = reader.ReadArray<double>();
+    // Итераторы доверяют размерам массивов, поэтому их согласованность проверяется сразу
+    const View& view = postings.view_;
+    const size_t size = postings.size();
+    const size_t block_count = (size + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    bool consistent = view.block_max_freqs.size() == block_count;
+    if (postings.compressed_) {
+        consistent = consistent && view.document_indexes.empty() && view.term_freqs.empty()
+                     && view.quantized_freqs.size() == size && view.blocks.size() == block_count;
+        for (size_t block = 0; consistent && block < view.blocks.size(); ++block) {
+            const Block& header = view.blocks[block];
+            const size_t count = std::min(POSTING_BLOCK_SIZE, size - block * POSTING_BLOCK_SIZE);
+            consistent = header.bit_width <= 32
+                         && header.offset + PackedBlockWords(count, header.bit_width) + POSTING_BLOCK_PADDING
+                            <= view.packed.size();
+        }
+    } else {
+        consistent = consistent && view.term_freqs.size() == size && view.blocks.empty() && view.packed.empty()
+                     && view.quantized_freqs.empty();
+    }
+    if (!consistent) {
+        throw std::runtime_error("Snapshot is corrupted");
+    }
+    return postings;
+}
+
+bool PostingList::HasValidDocumentIndexes(uint32_t document_count) const {
+    uint32_t min_document = 0;
+    for (BlockIterator block(*this); !block.AtEnd(); block.Next()) {
+        const uint32_t* document_indexes = block.DocumentIndexes();
+        const size_t count = block.size();
+        if (document_indexes[0] != block.FirstDocumentIndex()
+            || document_indexes[count - 1] != block.LastDocumentIndex()) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (document_indexes[i] < min_document || document_indexes[i] >= document_count) {
+                return false;
+            }
+            min_document = document_indexes[i] + 1;
+        }
+    }
+    return true;
+}
+
+void PostingList::UpdateView() {
+    view_ = {document_indexes_, term_freqs_, blocks_, packed_, quantized_freqs_, block_max_freqs_};
+}
+
+void PostingList::Detach() {
+    if (!mapped_) {
+        return;
+    }
+    mapped_ = false;
+    document_indexes_ = ToVector(view_.document_indexes);
+    term_freqs_ = ToVector(view_.term_freqs);
+    blocks_ = ToVector(view_.blocks);
+    packed_ = ToVector(view_.packed);
+    quantized_freqs_ = ToVector(view_.quantized_freqs);
+    block_max_freqs_ = ToVector(view_.block_max_freqs);
+    UpdateView();
+}
+
+void PostingList::AddFlat(uint32_t document_index, double term_freq) {
+    // Индексы документов выдаются по возрастанию, поэтому почти всегда это вставка в конец
+    if (document_indexes_.empty() || document_indexes_.back() < document_index) {
+        document_indexes_.push_back(document_index);
+        term_freqs_.push_back(term_freq);
+        max_term_freq_ = std::max(max_term_freq_, term_freq);
+        if (document_indexes_.size() % POSTING_BLOCK_SIZE == 1) {
+            block_max_freqs_.push_back(term_freq);
+        } else {
+            block_max_freqs_.back() = std::max(block_max_freqs_.back(), term_freq);
+        }
+        return;
+    }
+    const auto it = std::lower_bound(document_indexes_.begin(), document_indexes_.end(), document_index);
+    const auto offset = it - document_indexes_.begin();
+    if (it != document_indexes_.end() && *it == document_index) {
+        term_freqs_[offset] += term_freq;
+        max_term_freq_ = std::max(max_term_freq_, term_freqs_[offset]);
+        UpdateBlockMaxFreqs(offset / POSTING_BLOCK_SIZE);
+        return;
+    }
+    document_indexes_.insert(it, document_index);
+    term_freqs_.insert(term_freqs_.begin() + offset, term_freq);
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    UpdateBlockMaxFreqs(offset / POSTING_BLOCK_SIZE);
+}
+
+void PostingList::AddCompressed(uint32_t document_index, double term_freq) {
+    if (!blocks_.empty() && blocks_.back().last_document >= document_index) {
+        Decompress();
+        AddFlat(document_index, term_freq);
+        UpdateView();
+        Compress();
+        return;
+    }
+    const size_t tail = OwnedSize() % POSTING_BLOCK_SIZE;
+    uint32_t documents[POSTING_BLOCK_SIZE];
+    if (tail != 0) {
+        DecodeDocuments(blocks_.size() - 1, documents);
+        packed_.resize(blocks_.back().offset);
+        blocks_.pop_back();
+    }
+    documents[tail] = document_index;
+    quantized_freqs_.push_back(QuantizeFreq(term_freq));
+    max_term_freq_ = std::max(max_term_freq_, quantized_freqs_.back() * FREQ_QUANTUM);
+    AppendBlock(documents, tail + 1);
+    UpdateBlockMaxFreqs(blocks_.size() - 1);
+}
+
+size_t PostingList::OwnedSize() const {
+    return compressed_ ? quantized_freqs_.size() : document_indexes_.size();
+}
+
+double PostingList::GetTermFreq(size_t position) const {
+    return compressed_ ? quantized_freqs_[position] * FREQ_QUANTUM : term_freqs_[position];
+}
+
+void PostingList::UpdateMaxTermFreq() {
+    const auto max_it = std::max_element(block_max_freqs_.begin(), block_max_freqs_.end());
+    max_term_freq_ = max_it == block_max_freqs_.end() ? 0 : *max_it;
+}
+
+void PostingList::UpdateBlockMaxFreqs(size_t first_block) {
+    block_max_freqs_.resize((OwnedSize() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE);
+    for (size_t block = first_block; block < block_max_freqs_.size(); ++block) {
+        double max_freq = 0;
+        for (size_t i = block * POSTING_BLOCK_SIZE, last = std::min(OwnedSize(), i + POSTING_BLOCK_SIZE); i < last; ++i) {
+            max_freq = std::max(max_freq, GetTermFreq(i));
+        }
+        block_max_freqs_[block] = max_freq;
+    }
+}
+
+// Все блоки, кроме последнего, полные, так что новый блок всегда начинается с позиции blocks_.size() * 128
+void PostingList::AppendBlock(const uint32_t* document_indexes, size_t count) {
+    uint32_t deltas[POSTING_BLOCK_SIZE];
+    deltas[0] = 0;
+    for (size_t i = 1; i < count; ++i) {
+        deltas[i] = document_indexes[i] - document_indexes[i - 1];
+    }
+    const uint32_t bit_width = RequiredBitWidth(deltas, count);
+    const size_t offset = blocks_.empty()
+                          ? 0 : blocks_.back().offset + PackedBlockWords(POSTING_BLOCK_SIZE, blocks_.back().bit_width);
+    const size_t words = PackedBlockWords(count, bit_width);
+    packed_.resize(offset);
+    packed_.resize(offset + words + POSTING_BLOCK_PADDING);
+    PackBlock(deltas, count, bit_width, packed_.data() + offset);
+    blocks_.push_back({document_indexes[0], document_indexes[count - 1], static_cast<uint32_t>(offset), bit_width});
+}
+
+void PostingList::DecodeDocuments(size_t block, uint32_t* document_indexes) const {
+    const Block& header = view_.blocks[block];
+    const size_t count = std::min(POSTING_BLOCK_SIZE, size() - block * POSTING_BLOCK_SIZE);
+    UnpackBlock(view_.packed.data() + header.offset, count, header.bit_width, document_indexes);
+    PrefixSum(document_indexes, count, header.first_document);
+}
+
+PostingList::BlockIterator::BlockIterator(const PostingList& postings)
+        : postings_(&postings), block_count_((postings.size() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE) {
+}
+
+bool PostingList::BlockIterator::AtEnd() const {
+    return block_ >= block_count_;
+}
+
+void PostingList::BlockIterator::Next() {
+    ++block_;
+    decoded_ = false;
+}
+
+void PostingList::BlockIterator::SkipTo(uint32_t document_index) {
+    if (AtEnd()) {
+        return;
+    }
+    size_t block;
+    if (postings_->compressed_) {
+        block = std::partition_point(postings_->view_.blocks.begin() + block_, postings_->view_.blocks.end(),
+                                     [document_index](const Block& header) {
+                                         return header.last_document < document_index;
+                                     }) - postings_->view_.blocks.begin();
+    } else {
+        const auto& document_indexes = postings_->view_.document_indexes;
+        const auto it = std::lower_bound(document_indexes.begin() + block_ * POSTING_BLOCK_SIZE, document_indexes.end(),
+                                         document_index);
+        block = it == document_indexes.end() ? block_count_ : (it - document_indexes.begin()) / POSTING_BLOCK_SIZE;
+    }
+    if (block != block_) {
+        block_ = block;
+        decoded_ = false;
+    }
+}
+
+size_t PostingList::BlockIterator::size() const {
+    return std::min(POSTING_BLOCK_SIZE, postings_->size() - block_ * POSTING_BLOCK_SIZE);
+}
+
+uint32_t PostingList::BlockIterator::FirstDocumentIndex() const {
+    return postings_->compressed_ ? postings_->view_.blocks[block_].first_document
+                                  : postings_->view_.document_indexes[block_ * POSTING_BLOCK_SIZE];
+}
+
+uint32_t PostingList::BlockIterator::LastDocumentIndex() const {
+    return postings_->compressed_ ? postings_->view_.blocks[block_].last_document
+                                  : postings_->view_.document_indexes[block_ * POSTING_BLOCK_SIZE + size() - 1];
+}
+
+double PostingList::BlockIterator::MaxTermFreq() const {
+    return postings_->view_.block_max_freqs[block_];
+}
+
+const uint32_t* PostingList::BlockIterator::DocumentIndexes() const {
+    if (!postings_->compressed_) {
+        return postings_->view_.document_indexes.data() + block_ * POSTING_BLOCK_SIZE;
+    }
+    Decode();
+    return document_buffer_;
+}
+
+const double* PostingList::BlockIterator::TermFreqs() const {
+    if (!postings_->compressed_) {
+        return postings_->view_.term_freqs.data() + block_ * POSTING_BLOCK_SIZE;
+    }
+    Decode();
+    return freq_buffer_;
+}
+
+void PostingList::BlockIterator::Decode() const {
+    if (decoded_) {
+        return;
+    }
+    decoded_ = true;
+    postings_->DecodeDocuments(block_, document_buffer_);
+    const uint16_t* quantized_freqs = postings_->view_.quantized_freqs.data() + block_ * POSTING_BLOCK_SIZE;
+    for (size_t i = 0, count = size(); i < count; ++i) {
+        freq_buffer_[i] = quantized_freqs[i] * FREQ_QUANTUM;
+    }
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+        : block_(postings) {
+    UpdateDocumentIndex();
+}
+
+double PostingList::Cursor::TermFreq() const {
+    return block_.TermFreqs()[position_];
+}
+
+void PostingList::Cursor::Next() {
+    if (++position_ == block_.size()) {
+        block_.Next();
+        position_ = 0;
+    }
+    UpdateDocumentIndex();
+}
+
+void PostingList::Cursor::SkipTo(uint32_t document_index) {
+    if (document_index_ >= document_index) {
+        return;
+    }
+    ShallowSkipTo(document_index);
+    if (block_.AtEnd()) {
+        return;
+    }
+    const uint32_t* document_indexes = block_.DocumentIndexes();
+    position_ = std::lower_bound(document_indexes + position_, document_indexes + block_.size(), document_index)
+                - document_indexes;
+    UpdateDocumentIndex();
+}
+
+void PostingList::Cursor::ShallowSkipTo(uint32_t document_index) {
+    if (block_.AtEnd() || block_.LastDocumentIndex() >= document_index) {
+        return;
+    }
+    block_.SkipTo(document_index);
+    position_ = 0;
+    document_index_ = block_.AtEnd() ? END_DOCUMENT : block_.FirstDocumentIndex();
+}
+
+double PostingList::Cursor::BlockMaxTermFreq() const {
+    return block_.AtEnd() ? 0 : block_.MaxTermFreq();
+}
+
+void PostingList::Cursor::UpdateDocumentIndex() {
+    document_index_ = block_.AtEnd() ? END_DOCUMENT : block_.DocumentIndexes()[position_];
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "posting_codec.h"
+#include "snapshot.h"
+
+// Список вхождений терма: индексы документов по возрастанию и их TF.
+// Хранится либо плоско, в параллельных массивах, либо в сжатом виде: разности индексов
+// упакованы блоками по 128 (posting_codec.h), а TF квантованы до 16 бит.
+// Читается в обоих случаях через BlockIterator, блоками до 128 вхождений.
+// Список, открытый из снимка, читается прямо из отображённого файла и копируется в память при первом изменении
+class PostingList {
+public:
+    class BlockIterator;
+
+    class Cursor;
+
+    PostingList() = default;
+
+    PostingList(const PostingList& other);
+
+    PostingList& operator=(const PostingList& other);
+
+    PostingList(PostingList&&) noexcept = default;
+
+    PostingList& operator=(PostingList&&) noexcept = default;
+
+    void Add(uint32_t document_index, double term_freq);
+
+    bool Remove(uint32_t document_index);
+
+    bool Contains(uint32_t document_index) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    // Наибольший TF в списке в том виде, в каком его отдают итераторы: верхняя граница для отсечения
+    double GetMaxTermFreq() const;
+
+    // То же для каждого блока из 128 вхождений
+    double GetBlockMaxTermFreq(size_t block) const;
+
+    BlockIterator Blocks() const;
+
+    Cursor Begin() const;
+
+    // Сжатый список дописывается в конец за O(128), остальные изменения распаковывают его целиком
+    void Compress();
+
+    void Decompress();
+
+    bool IsCompressed() const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    // Массивы списка указывают в память reader, она должна жить дольше списка
+    static PostingList Map(SnapshotReader& reader);
+
+    // Индексы строго возрастают, меньше document_count и совпадают с границами в заголовках блоков.
+    // Распаковывает весь список: нужна для списков из снимка, которым итераторы иначе верят на слово
+    bool HasValidDocumentIndexes(uint32_t document_count) const;
+
+private:
+    struct Block {
+        uint32_t first_document;
+        uint32_t last_document;
+        uint32_t offset;
+        uint32_t bit_width;
+    };
+
+    // Всё, что читают итераторы: либо собственные массивы ниже, либо память снимка
+    struct View {
+        std::span<const uint32_t> document_indexes;
+        std::span<const double> term_freqs;
+        std::span<const Block> blocks;
+        std::span<const uint32_t> packed;
+        std::span<const uint16_t> quantized_freqs;
+        std::span<const double> block_max_freqs;
+    };
+
+    View view_;
+    bool mapped_ = false;
+
+    std::vector<uint32_t> document_indexes_;
+    std::vector<double> term_freqs_;
+
+    bool compressed_ = false;
+    std::vector<Block> blocks_;
+    std::vector<uint32_t> packed_;
+    std::vector<uint16_t> quantized_freqs_;
+    double max_term_freq_ = 0;
+    std::vector<double> block_max_freqs_;
+
+    // Вызывается после каждого изменения собственных массивов
+    void UpdateView();
+
+    // Копирует список из снимка в собственные массивы перед изменением
+    void Detach();
+
+    void AddFlat(uint32_t document_index, double term_freq);
+
+    void AddCompressed(uint32_t document_index, double term_freq);
+
+    // Длина и TF по собственным массивам, пока view_ ещё не обновлён
+    size_t OwnedSize() const;
+
+    double GetTermFreq(size_t position) const;
+
+    void UpdateMaxTermFreq();
+
+    // Пересчитывает максимумы блоков начиная с first_block, после того как вхождения в них сдвинулись
+    void UpdateBlockMaxFreqs(size_t first_block);
+
+    void AppendBlock(const uint32_t* document_indexes, size_t count);
+
+    void DecodeDocuments(size_t block, uint32_t* document_indexes) const;
+};
+
+class PostingList::BlockIterator {
+public:
+    explicit BlockIterator(const PostingList& postings);
+
+    bool AtEnd() const;
+
+    void Next();
+
+    // Переходит к первому блоку, в котором могут быть индексы не меньше document_index
+    void SkipTo(uint32_t document_index);
+
+    size_t size() const;
+
+    // Границы и максимальный TF блока берутся из заголовка, без распаковки
+    uint32_t FirstDocumentIndex() const;
+
+    uint32_t LastDocumentIndex() const;
+
+    double MaxTermFreq() const;
+
+    const uint32_t* DocumentIndexes() const;
+
+    const double* TermFreqs() const;
+
+private:
+    const PostingList* postings_;
+    size_t block_ = 0;
+    size_t block_count_;
+    // Сжатый блок распаковывается при первом обращении к данным, так что пропуск блока ничего не стоит
+    mutable bool decoded_ = false;
+    alignas(32) mutable uint32_t document_buffer_[POSTING_BLOCK_SIZE];
+    alignas(32) mutable double freq_buffer_[POSTING_BLOCK_SIZE];
+
+    void Decode() const;
+};
+
+// Поэлементный курсор поверх BlockIterator для обхода нескольких списков по документам
+class PostingList::Cursor {
+public:
+    explicit Cursor(const PostingList& postings);
+
+    static constexpr uint32_t END_DOCUMENT = UINT32_MAX;
+
+    bool AtEnd() const {
+        return document_index_ == END_DOCUMENT;
+    }
+
+    // После конца списка возвращает END_DOCUMENT, который больше любого индекса
+    uint32_t DocumentIndex() const {
+        return document_index_;
+    }
+
+    double TermFreq() const;
+
+    void Next();
+
+    // Переходит к первому вхождению с индексом не меньше document_index
+    void SkipTo(uint32_t document_index);
+
+    // Переходит к началу блока, который может содержать document_index, не распаковывая его.
+    // После этого BlockMaxTermFreq() ограничивает TF этого документа
+    void ShallowSkipTo(uint32_t document_index);
+
+    // Максимальный TF текущего блока; 0 после конца списка
+    double BlockMaxTermFreq() const;
+
+private:
+    BlockIterator block_;
+    size_t position_ = 0;
+    uint32_t document_index_;
+
+    void UpdateDocumentIndex();
+};
@@ -3,20 +3,26 @@
 std::vector<std::vector<Document>>
 ProcessQueries(const SearchServer& search_server, const vector<std::string>& queries) {
     std::vector<std::vector<Document>> answer(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), answer.begin(),
-                   [&search_server](const string& query) {
-                       return search_server.FindTopDocuments(query);
-                   });
+    ProcessQueriesStreaming(search_server, queries, [&answer](size_t query, std::vector<Document> documents) {
+        answer[query] = std::move(documents);
+    });
     return answer;
 }
 
-vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries) {
-    ProcessQueries(search_server, queries);
-    std::vector<Document> document_flat;
-    for (const std::vector<Document>& documents : ProcessQueries(search_server, queries)) {
-        for (const Document& document : documents) {
-            document_flat.push_back(document);
-        }
-    }
-    return document_flat;
-}
\ No newline at end of file
+std::vector<std::vector<Document>>
+ProcessQueriesBatched(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    return search_server.FindTopDocumentsBatch(queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    return std::views::join(ProcessQueries(search_server, queries));
+}
+
+void ProcessQueriesStreaming(const SearchServer& search_server, const std::vector<std::string>& queries,
+                             const std::function<void(size_t, std::vector<Document>)>& sink) {
+    // На executor сервера запросы и их параллельные части делят один пул
+    ParallelFor(search_server.GetExecutor(), std::execution::par, queries.size(),
+                [&search_server, &queries, &sink](size_t query) {
+                    sink(query, search_server.FindTopDocuments(queries[query]));
+                });
+}
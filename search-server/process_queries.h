@@ -1,15 +1,34 @@
 #pragma once
 
+#include <functional>
+#include <ranges>
 #include <vector>
 #include <execution>
 
 #include "document.h"
 #include "search_server.h"
 
+// Выдачи запросов подряд одним диапазоном: документы не копируются в общий вектор
+using JoinedDocuments = std::ranges::join_view<std::ranges::owning_view<std::vector<std::vector<Document>>>>;
+
 std::vector<std::vector<Document>> ProcessQueries(
         const SearchServer& search_server,
         const std::vector<std::string>& queries);
 
-vector<Document> ProcessQueriesJoined(
+// Те же выдачи, что у ProcessQueries, но список вхождений слова обходится один раз для всех запросов группы,
+// где оно встречается (SearchServer::FindTopDocumentsBatch). Выгодно для больших пакетов похожих запросов;
+// релевантность может отличаться в последних знаках
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries);
+
+JoinedDocuments ProcessQueriesJoined(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries);
+
+// Отдаёт sink(номер запроса, выдача) каждую выдачу, как только запрос выполнен, ничего не накапливая.
+// Запросы идут параллельно, поэтому sink вызывается из нескольких потоков сразу и в любом порядке
+void ProcessQueriesStreaming(
         const SearchServer& search_server,
-        const std::vector<std::string>& queries);
\ No newline at end of file
+        const std::vector<std::string>& queries,
+        const std::function<void(size_t, std::vector<Document>)>& sink);
@@ -0,0 +1,70 @@
+#include <algorithm>
+
+#include "query_cache.h"
+
+namespace {
+
+void HashCombine(size_t& seed, size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
+
+QueryCache::QueryCache(size_t capacity, size_t bucket_count)
+        : bucket_capacity_(std::max<size_t>(1, (capacity + bucket_count - 1) / bucket_count)),
+          buckets_(bucket_count) {
+}
+
+std::optional<std::vector<Document>> QueryCache::Find(const Key& key, uint64_t generation) {
+    Bucket& bucket = GetBucket(KeyHash{}(key));
+    std::lock_guard guard(bucket.mutex);
+    const auto it = bucket.entries.find(key);
+    if (it == bucket.entries.end() || it->second.generation != generation) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    bucket.lru.splice(bucket.lru.begin(), bucket.lru, it->second.lru_position);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second.documents;
+}
+
+void QueryCache::Insert(Key key, uint64_t generation, std::vector<Document> documents) {
+    Bucket& bucket = GetBucket(KeyHash{}(key));
+    std::lock_guard guard(bucket.mutex);
+    if (const auto it = bucket.entries.find(key); it != bucket.entries.end()) {
+        it->second.generation = generation;
+        it->second.documents = std::move(documents);
+        bucket.lru.splice(bucket.lru.begin(), bucket.lru, it->second.lru_position);
+        return;
+    }
+    if (bucket.entries.size() == bucket_capacity_) {
+        bucket.entries.erase(*bucket.lru.back());
+        bucket.lru.pop_back();
+    }
+    const auto it = bucket.entries.emplace(std::move(key), Entry{generation, std::move(documents), {}}).first;
+    bucket.lru.push_front(&it->first);
+    it->second.lru_position = bucket.lru.begin();
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+    return {hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed)};
+}
+
+size_t QueryCache::KeyHash::operator()(const Key& key) const {
+    size_t seed = key.plus_terms.size();
+    for (const uint32_t term : key.plus_terms) {
+        HashCombine(seed, term);
+    }
+    HashCombine(seed, key.minus_terms.size());
+    for (const uint32_t term : key.minus_terms) {
+        HashCombine(seed, term);
+    }
+    HashCombine(seed, static_cast<size_t>(key.status));
+    HashCombine(seed, key.top_count);
+    return seed;
+}
+
+QueryCache::Bucket& QueryCache::GetBucket(size_t hash) {
+    // Младшие биты хэша выбирают корзину внутри unordered_map, поэтому бакет берётся по старшим
+    return buckets_[(hash >> 32) % buckets_.size()];
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+// Кэш выдачи FindTopDocuments с вытеснением давно не запрашивавшихся записей (LRU).
+// Разбит на бакеты со своими мьютексами, чтобы параллельные запросы не ждали друг друга.
+// Запись помнит поколение индекса, для которого посчитана, и после его смены считается промахом
+class QueryCache {
+public:
+    // Нормализованный запрос: id термов без стоп-слов и слов, которых нет ни в одном документе
+    struct Key {
+        std::vector<uint32_t> plus_terms;
+        std::vector<uint32_t> minus_terms;
+        DocumentStatus status;
+        size_t top_count;
+
+        bool operator==(const Key& other) const = default;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // capacity — общее число записей, оно делится между бакетами поровну
+    explicit QueryCache(size_t capacity, size_t bucket_count = 16);
+
+    std::optional<std::vector<Document>> Find(const Key& key, uint64_t generation);
+
+    void Insert(Key key, uint64_t generation, std::vector<Document> documents);
+
+    Stats GetStats() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        uint64_t generation;
+        std::vector<Document> documents;
+        std::list<const Key*>::iterator lru_position;
+    };
+
+    struct Bucket {
+        std::mutex mutex;
+        // Ключи от недавно запрошенных к давним; указывают на ключи entries, которые не переезжают
+        std::list<const Key*> lru;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+    };
+
+    size_t bucket_capacity_;
+    std::vector<Bucket> buckets_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+
+    Bucket& GetBucket(size_t hash);
+};
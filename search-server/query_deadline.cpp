@@ -0,0 +1,20 @@
+#include "query_deadline.h"
+
+QueryDeadline::QueryDeadline(std::chrono::steady_clock::time_point deadline, std::stop_token stop_token)
+        : deadline_(deadline), stop_token_(std::move(stop_token)) {
+}
+
+bool QueryDeadline::Expired() const {
+    if (interrupted_.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    if (stop_token_.stop_requested() || std::chrono::steady_clock::now() >= deadline_) {
+        interrupted_.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool QueryDeadline::WasInterrupted() const {
+    return interrupted_.load(std::memory_order_relaxed);
+}
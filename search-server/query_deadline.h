@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stop_token>
+
+// Срок и отмена запроса. Поиск спрашивает Expired() между списками вхождений и, получив true,
+// прекращает обход и отдаёт лучшее из уже найденного
+class QueryDeadline {
+public:
+    explicit QueryDeadline(std::chrono::steady_clock::time_point deadline, std::stop_token stop_token = {});
+
+    // Истёк ли срок или запрошена отмена. Проверки идут из нескольких потоков запроса сразу
+    bool Expired() const;
+
+    // true, если хотя бы одна проверка сработала, то есть часть работы пропущена
+    bool WasInterrupted() const;
+
+private:
+    std::chrono::steady_clock::time_point deadline_;
+    std::stop_token stop_token_;
+    mutable std::atomic<bool> interrupted_ = false;
+};
@@ -1,3 +1,29 @@
+#pragma once
+
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Удаляет документы с тем же набором слов, что у документа с меньшим id, и сообщает о каждом удалённом
+template<typename Policy>
+void RemoveDuplicates(Policy policy, SearchServer& search_server) {
+    const vector<int> duplicates = search_server.FindDuplicateDocuments(policy);
+    search_server.RemoveDocuments(duplicates);
+    for (const int id : duplicates) {
+        cout << "Found duplicate document id "s << id << '\n';
+    }
+}
+
+void RemoveDuplicates(SearchServer& search_server);
+
+// Из каждой группы похожих документов (SearchServer::FindNearDuplicateDocuments) оставляет документ с меньшим id
+template<typename Policy>
+void RemoveNearDuplicates(Policy policy, SearchServer& search_server, double jaccard_threshold) {
+    vector<int> duplicates;
+    for (const vector<int>& group : search_server.FindNearDuplicateDocuments(policy, jaccard_threshold)) {
+        duplicates.insert(duplicates.end(), group.begin() + 1, group.end());
+    }
+    sort(duplicates.begin(), duplicates.end());
+    search_server.RemoveDocuments(duplicates);
+    for (const int id : duplicates) {
+        cout << "Found near duplicate document id "s << id << '\n';
+    }
+}
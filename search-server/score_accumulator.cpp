@@ -0,0 +1,48 @@
+#include "score_accumulator.h"
+
+namespace {
+
+thread_local std::vector<std::unique_ptr<ScoreAccumulator>> free_accumulators;
+
+} // namespace
+
+void ScoreAccumulator::Releaser::operator()(ScoreAccumulator* accumulator) const {
+    accumulator->Clear();
+    free_accumulators.emplace_back(accumulator);
+}
+
+ScoreAccumulator::Ptr ScoreAccumulator::Acquire(uint32_t first_document_index, uint32_t end_document_index) {
+    std::unique_ptr<ScoreAccumulator> accumulator;
+    if (free_accumulators.empty()) {
+        accumulator = std::make_unique<ScoreAccumulator>();
+    } else {
+        accumulator = std::move(free_accumulators.back());
+        free_accumulators.pop_back();
+    }
+    const size_t document_count = end_document_index - first_document_index;
+    if (accumulator->scores_.size() < document_count) {
+        accumulator->scores_.resize(document_count);
+        accumulator->states_.resize(document_count);
+    }
+    accumulator->first_document_index_ = first_document_index;
+    return Ptr(accumulator.release());
+}
+
+void ScoreAccumulator::Merge(const ScoreAccumulator& other) {
+    for (const uint32_t document_index : other.touched_) {
+        const uint32_t position = document_index - first_document_index_;
+        if (states_[position] == State::EMPTY) {
+            states_[position] = other.states_[position];
+            touched_.push_back(document_index);
+        }
+        scores_[position] += other.scores_[position];
+    }
+}
+
+void ScoreAccumulator::Clear() {
+    for (const uint32_t document_index : touched_) {
+        scores_[document_index - first_document_index_] = 0;
+        states_[document_index - first_document_index_] = State::EMPTY;
+    }
+    touched_.clear();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Плотный массив очков, адресуемый индексом документа, с журналом затронутых ячеек.
+// После запроса обнуляются только затронутые ячейки, поэтому массивы переиспользуются
+// из пула потока без полной очистки и без блокировок при накоплении
+class ScoreAccumulator {
+public:
+    enum class State : uint8_t {
+        EMPTY,
+        SCORED,
+        REJECTED,
+    };
+
+    struct Releaser {
+        void operator()(ScoreAccumulator* accumulator) const;
+    };
+
+    using Ptr = std::unique_ptr<ScoreAccumulator, Releaser>;
+
+    // Массив для документов с индексами [first_document_index, end_document_index) из пула текущего потока;
+    // по освобождении он очищается и возвращается в пул. Размер массива — длина диапазона, а не всего индекса
+    static Ptr Acquire(uint32_t first_document_index, uint32_t end_document_index);
+
+    static Ptr Acquire(size_t document_count) {
+        return Acquire(0, static_cast<uint32_t>(document_count));
+    }
+
+    State GetState(uint32_t document_index) const {
+        return states_[document_index - first_document_index_];
+    }
+
+    // Первое обращение к документу: predicate_result решает, будет ли он учитываться
+    void Touch(uint32_t document_index, bool predicate_result) {
+        states_[document_index - first_document_index_] = predicate_result ? State::SCORED : State::REJECTED;
+        touched_.push_back(document_index);
+    }
+
+    void Add(uint32_t document_index, double score) {
+        scores_[document_index - first_document_index_] += score;
+    }
+
+    void Reject(uint32_t document_index) {
+        State& state = states_[document_index - first_document_index_];
+        if (state == State::SCORED) {
+            state = State::REJECTED;
+        }
+    }
+
+    // Диапазоны документов обоих массивов должны совпадать
+    void Merge(const ScoreAccumulator& other);
+
+    double GetScore(uint32_t document_index) const {
+        return scores_[document_index - first_document_index_];
+    }
+
+    // Индексы документов, а не позиции в массиве
+    const std::vector<uint32_t>& GetTouched() const {
+        return touched_;
+    }
+
+private:
+    uint32_t first_document_index_ = 0;
+    std::vector<double> scores_;
+    std::vector<State> states_;
+    std::vector<uint32_t> touched_;
+
+    void Clear();
+};
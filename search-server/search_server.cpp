@@ -1,36 +1,101 @@
 #include <deque>
+#include <limits>
+#include <unordered_set>
 #include "search_server.h"
 
 
 void SearchServer::AddDocument(int document_id, const string_view& document, DocumentStatus status,
                                const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_indexes_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
+    InstallMerge(false);
     const auto words = SplitIntoWordsNoStop(document);
+    if (duplicate_handling_ != DuplicateHandling::ALLOW) {
+        vector<string_view> unique_words = words;
+        sort(unique_words.begin(), unique_words.end());
+        unique_words.erase(unique(unique_words.begin(), unique_words.end()), unique_words.end());
+        if (const auto original_id = FindDocumentWithWords(unique_words);
+                original_id && !HandleDuplicate(document_id, *original_id)) {
+            return;
+        }
+    }
+    const auto document_index = static_cast<uint32_t>(documents_.size());
 
     const double inv_word_count = 1.0 / words.size();
+    auto& word_freqs = documents_to_words_freqs_[document_id];
     for (basic_string_view<char> word : words) {
-        word_to_document_freqs_[string(word)][document_id] += inv_word_count;
-        documents_to_words_freqs_[document_id][string(word)] += inv_word_count;
+        word_freqs[terms_[InternTerm(word)].word] += inv_word_count;
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    IndexSegment& segment = *segments_.back();
+    const size_t first_term = document_term_ids_.size();
+    for (const auto& [word, term_freq] : word_freqs) {
+        const uint32_t term_id = term_ids_.at(word);
+        segment.GetPostings(term_id).Add(document_index, term_freq);
+        ++terms_[term_id].document_count;
+        document_term_ids_.push_back(term_id);
+    }
+    sort(document_term_ids_.begin() + static_cast<ptrdiff_t>(first_term), document_term_ids_.end());
+    document_term_offsets_.push_back(document_term_ids_.size());
+    segment.AddDocuments(1);
+    documents_.push_back(DocumentData{document_id, ComputeAverageRating(ratings), status});
+    removed_documents_.push_back(false);
+    document_indexes_.emplace(document_id, document_index);
     document_ids_.insert(document_id);
+    if (duplicate_handling_ != DuplicateHandling::ALLOW) {
+        InsertSignature(document_index);
+    }
+    ++corpus_epoch_;
+    SealFullSegment();
 }
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query,
-                            [status](int document_id, DocumentStatus document_status, int rating) {
-                                return document_status == status;
-                            });
+void SearchServer::AddDocuments(span<const NewDocument> documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, top_count);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+SearchServer::PreparedQuery SearchServer::PrepareQuery(string_view raw_query) const {
+    PreparedQuery query;
+    query.text_ = make_shared<const string>(raw_query);
+    query.query_ = ParseSearchQuery(std::execution::seq, *query.text_);
+    query.server_ = this;
+    query.epoch_ = GetCorpusEpoch();
+    query.terms_ = ResolveQuery(query.query_);
+    return query;
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status,
+                                                size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, query, status, top_count);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query) const {
+    return FindTopDocuments(std::execution::seq, query, DocumentStatus::ACTUAL);
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_indexes_.size();
+}
+
+future<SearchResult> SearchServer::FindTopDocumentsAsync(string raw_query, chrono::steady_clock::time_point deadline,
+                                                         DocumentStatus status, size_t top_count,
+                                                         stop_token stop_token) const {
+    return FindTopDocumentsAsync(std::move(raw_query), deadline,
+                                 [status](int, DocumentStatus document_status, int) {
+                                     return document_status == status;
+                                 }, top_count, std::move(stop_token));
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(span<const string> raw_queries, DocumentStatus status,
+                                                             size_t top_count) const {
+    return FindTopDocumentsBatch(std::execution::par, raw_queries, status, top_count);
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
@@ -38,33 +103,34 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_vi
         throw invalid_argument("invalid_argument"s);
     }
     const auto query = ParseQuery(raw_query);
+    const uint32_t document_index = document_indexes_.at(document_id);
     bool empty_return = false;
     vector<string_view> matched_words;
     for (const string_view word : query.minus_words) {
-        string word_str = string(word);
-        if (word_to_document_freqs_.count(word_str) == 0) {
+        const TermData* term = FindTerm(word);
+        if (term == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word_str).count(document_id)) {
+        if (IsWordInDocument(document_index, *term)) {
             empty_return = true;
             break;
         }
     }
     if (empty_return) {
-        return {vector<string_view>{}, documents_.at(document_id).status};
+        return {vector<string_view>{}, documents_[document_index].status};
     }
 
     for (basic_string_view<char> word : query.plus_words) {
-        string word_str = string(word);
-        if (word_to_document_freqs_.count(word_str) == 0) {
+        const TermData* term = FindTerm(word);
+        if (term == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word_str).count(document_id)) {
+        if (IsWordInDocument(document_index, *term)) {
             matched_words.push_back(word);
         }
     }
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, documents_[document_index].status};
 }
 
 tuple<vector<string_view>, DocumentStatus>
@@ -73,33 +139,34 @@ SearchServer::MatchDocument(std::execution::sequenced_policy policy, string_view
         throw invalid_argument("invalid_argument"s);
     }
     const auto query = ParseQuery(raw_query);
+    const uint32_t document_index = document_indexes_.at(document_id);
     bool empty_return = false;
     vector<string_view> matched_words;
     for (const string_view word : query.minus_words) {
-        string word_str = string(word);
-        if (word_to_document_freqs_.count(word_str) == 0) {
+        const TermData* term = FindTerm(word);
+        if (term == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word_str).count(document_id)) {
+        if (IsWordInDocument(document_index, *term)) {
             empty_return = true;
             break;
         }
     }
     if (empty_return) {
-        return {vector<string_view>{}, documents_.at(document_id).status};
+        return {vector<string_view>{}, documents_[document_index].status};
     }
 
     for (basic_string_view<char> word : query.plus_words) {
-        string word_str = string(word);
-        if (word_to_document_freqs_.count(word_str) == 0) {
+        const TermData* term = FindTerm(word);
+        if (term == nullptr) {
             continue;
         }
-        if (word_to_document_freqs_.at(word_str).count(document_id)) {
+        if (IsWordInDocument(document_index, *term)) {
             matched_words.push_back(word);
         }
     }
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, documents_[document_index].status};
 }
 
 tuple<vector<string_view>, DocumentStatus>
@@ -107,60 +174,290 @@ SearchServer::MatchDocument(std::execution::parallel_policy policy, string_view
     if (!CorrectUseDashes(raw_query) || !IsValidWord(raw_query)) {
         throw invalid_argument("invalid_argument"s);
     }
+    return MatchParsedQuery(policy, ParseQueryForPar(raw_query), document_id);
+}
 
+tuple<vector<string_view>, DocumentStatus>
+SearchServer::MatchDocument(AdaptivePolicy, string_view raw_query, int document_id) const {
+    if (!CorrectUseDashes(raw_query) || !IsValidWord(raw_query)) {
+        throw invalid_argument("invalid_argument"s);
+    }
+    // Проверка слова — двоичный поиск по термам документа, она дешевле обхода одного блока списка
     const auto query = ParseQueryForPar(raw_query);
+    const size_t word_count = query.plus_words.size() + query.minus_words.size();
+    if (ChooseAdaptiveParallelism(word_count) == 1) {
+        return MatchParsedQuery(std::execution::seq, query, document_id);
+    }
+    return MatchParsedQuery(std::execution::par, query, document_id);
+}
 
-    if (any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-               [this, document_id](string_view word) {
-                   string word_str = string(word);
-                   if (word_to_document_freqs_.count(word_str) == 0) {
-                       return false;
-                   }
-                   if (IsWordInDocument(document_id, word_str)) {
-                       return true;
-                   }
-                   return false;
-               })) {
+vector<tuple<vector<string_view>, DocumentStatus>>
+SearchServer::MatchDocuments(string_view raw_query, span<const int> document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
 
-        return {vector<string_view>{}, documents_.at(document_id).status};
+vector<vector<SearchServer::QueryTerm>>
+SearchServer::GroupTermsForWorkers(const vector<QueryTerm>& terms, size_t group_count) const {
+    group_count = min(group_count, terms.size());
+    if (group_count <= 1) {
+        return terms.empty() ? vector<vector<QueryTerm>>{} : vector<vector<QueryTerm>>{terms};
     }
 
-    vector<string_view> matched_words(query.plus_words.size());
-    matched_words.reserve(10000);
+    // Длинные списки раздаются первыми, каждый — в наименее загруженную группу
+    vector<QueryTerm> sorted_terms = terms;
+    stable_sort(sorted_terms.begin(), sorted_terms.end(), [this](const QueryTerm& lhs, const QueryTerm& rhs) {
+        return terms_[lhs.term_id].document_count > terms_[rhs.term_id].document_count;
+    });
+    vector<vector<QueryTerm>> groups(group_count);
+    vector<size_t> group_sizes(group_count);
+    for (const QueryTerm& term : sorted_terms) {
+        const size_t group = min_element(group_sizes.begin(), group_sizes.end()) - group_sizes.begin();
+        groups[group].push_back(term);
+        group_sizes[group] += terms_[term.term_id].document_count;
+    }
+    return groups;
+}
 
-    transform(std::execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(),
-              [this, document_id](string_view word) {
-                  string word_str = string(word);
-                  if (word_to_document_freqs_.count(word_str) == 0) {
-                      return string_view{""};
-                  }
-                  if (IsWordInDocument(document_id, word_str)) {
-                      return word;
-                  }
-                  return string_view{""};
-              });
+vector<SearchServer::QueryTerm> SearchServer::FindQueryTerms(const vector<string_view>& words) const {
+    vector<QueryTerm> terms;
+    terms.reserve(words.size());
+    for (string_view word : words) {
+        const TermData* term = FindTerm(word);
+        if (term != nullptr && term->document_count > 0) {
+            terms.push_back({GetTermId(*term), ComputeWordInverseDocumentFreq(*term)});
+        }
+    }
+    return terms;
+}
 
-    std::sort(std::execution::par, matched_words.begin(), matched_words.end());
-    auto last = std::unique(std::execution::par, matched_words.begin(), matched_words.end());
-    matched_words.erase(last, matched_words.end());
+vector<SearchServer::TermCursor> SearchServer::MakeTermCursors(const IndexSegment& segment,
+                                                               const vector<QueryTerm>& terms) const {
+    vector<TermCursor> cursors;
+    cursors.reserve(terms.size());
+    for (const QueryTerm& term : terms) {
+        const PostingList* postings = segment.FindPostings(term.term_id);
+        if (postings == nullptr || postings->empty()) {
+            continue;
+        }
+        // Максимум TF берётся по списку сегмента, он не больше общего и даёт более точную границу
+        cursors.push_back({postings->Begin(), term.inverse_document_freq,
+                           postings->GetMaxTermFreq() * term.inverse_document_freq, postings->size()});
+    }
+    return cursors;
+}
 
-    if (matched_words.begin()->size()) {
-        matched_words.erase(matched_words.begin());
+bool SearchServer::IsWordInDocument(uint32_t document_index, const TermData& term) const {
+    const uint32_t term_id = GetTermId(term);
+    if (snapshot_ != nullptr && document_index < snapshot_->document_count) {
+        const auto word_freqs = GetSnapshotWordFreqs(documents_[document_index].id);
+        const auto it = lower_bound(word_freqs.begin(), word_freqs.end(), term_id,
+                                    [](const SnapshotWordFreq& word_freq, uint32_t id) {
+                                        return word_freq.term_id < id;
+                                    });
+        return it != word_freqs.end() && it->term_id == term_id;
     }
+    const auto first = document_term_ids_.begin() + static_cast<ptrdiff_t>(document_term_offsets_[document_index]);
+    const auto last = document_term_ids_.begin() + static_cast<ptrdiff_t>(document_term_offsets_[document_index + 1]);
+    return binary_search(first, last, term_id);
+}
 
-    return {matched_words, documents_.at(document_id).status};
+SearchServer::DocumentSignature SearchServer::ComputeDocumentSignature(uint32_t document_index) const {
+    // Суммы двух независимых перемешиваний id термов не зависят от порядка термов
+    DocumentSignature signature{0, 0};
+    ForEachDocumentTerm(document_index, [&signature](uint32_t term_id) {
+        AddTermToSignature(signature, term_id);
+    });
+    return signature;
+}
+
+void SearchServer::AddTermToSignature(DocumentSignature& signature, uint32_t term_id) {
+    const uint64_t hash = MixHash(term_id + 0x9e3779b97f4a7c15ULL);
+    signature.low += hash;
+    signature.high += MixHash(hash ^ 0xd6e8feb86659fd93ULL);
 }
 
-bool SearchServer::IsWordInDocument(int document_id, const string& word) const {
-    return count_if(std::execution::par, word_to_document_freqs_.at(word).begin(),
-                    word_to_document_freqs_.at(word).end(),
-                    [document_id](const pair<int, double>& ggg) {
-                                            return ggg.first == document_id;
-                                        });
+void SearchServer::InsertSignature(uint32_t document_index) {
+    const DocumentSignature signature = ComputeDocumentSignature(document_index);
+    signature_index_.emplace(signature.low, pair(signature.high, document_index));
+}
+
+void SearchServer::EraseSignature(uint32_t document_index) {
+    const auto [first, last] = signature_index_.equal_range(ComputeDocumentSignature(document_index).low);
+    for (auto it = first; it != last; ++it) {
+        if (it->second.second == document_index) {
+            signature_index_.erase(it);
+            return;
+        }
+    }
+}
+
+optional<int> SearchServer::FindDocumentWithWords(const vector<string_view>& words) const {
+    // Документ с новым словом не может совпасть с добавленным
+    vector<uint32_t> term_ids;
+    term_ids.reserve(words.size());
+    for (const string_view word : words) {
+        const TermData* term = FindTerm(word);
+        if (term == nullptr) {
+            return nullopt;
+        }
+        term_ids.push_back(GetTermId(*term));
+    }
+    sort(term_ids.begin(), term_ids.end());
+    DocumentSignature signature{0, 0};
+    for (const uint32_t term_id : term_ids) {
+        AddTermToSignature(signature, term_id);
+    }
+    vector<uint32_t> buffer;
+    const auto [first, last] = signature_index_.equal_range(signature.low);
+    for (auto it = first; it != last; ++it) {
+        const auto [high, document_index] = it->second;
+        if (high == signature.high && ranges::equal(GetDocumentTerms(document_index, buffer), term_ids)) {
+            return documents_[document_index].id;
+        }
+    }
+    return nullopt;
+}
+
+bool SearchServer::HandleDuplicate(int document_id, int original_id) const {
+    if (duplicate_handler_) {
+        duplicate_handler_(document_id, original_id);
+    }
+    return duplicate_handling_ != DuplicateHandling::REJECT;
+}
+
+vector<size_t> SearchServer::CheckDuplicates(span<const NewDocument> documents) const {
+    // Все тексты разбираются заранее, чтобы ошибка в любом из них бросалась до вызовов обработчика
+    vector<vector<string_view>> document_words(documents.size());
+    for (size_t number = 0; number < documents.size(); ++number) {
+        auto& words = document_words[number];
+        words = SplitIntoWordsNoStop(documents[number].text);
+        sort(words.begin(), words.end());
+        words.erase(unique(words.begin(), words.end()), words.end());
+    }
+
+    // Принятые документы пакета ещё не в индексе, поэтому следующие сравниваются с ними по хешу набора слов
+    unordered_multimap<uint64_t, size_t> batch_signatures;
+    vector<size_t> accepted;
+    accepted.reserve(documents.size());
+    for (size_t number = 0; number < documents.size(); ++number) {
+        const auto& words = document_words[number];
+        optional<int> original_id = FindDocumentWithWords(words);
+        if (!original_id) {
+            uint64_t hash = 0;
+            for (const string_view word : words) {
+                hash += MixHash(std::hash<string_view>{}(word));
+            }
+            const auto [first, last] = batch_signatures.equal_range(hash);
+            for (auto it = first; it != last && !original_id; ++it) {
+                if (document_words[it->second] == words) {
+                    original_id = documents[it->second].id;
+                }
+            }
+            if (!original_id) {
+                batch_signatures.emplace(hash, number);
+            }
+        }
+        if (!original_id || HandleDuplicate(documents[number].id, *original_id)) {
+            accepted.push_back(number);
+        }
+    }
+    return accepted;
+}
+
+bool SearchServer::HaveSameTerms(uint32_t lhs_document_index, uint32_t rhs_document_index) const {
+    vector<uint32_t> lhs_buffer;
+    vector<uint32_t> rhs_buffer;
+    return ranges::equal(GetDocumentTerms(lhs_document_index, lhs_buffer),
+                         GetDocumentTerms(rhs_document_index, rhs_buffer));
+}
+
+span<const uint32_t> SearchServer::GetDocumentTerms(uint32_t document_index, vector<uint32_t>& buffer) const {
+    if (snapshot_ != nullptr && document_index < snapshot_->document_count) {
+        buffer.clear();
+        ForEachDocumentTerm(document_index, [&buffer](uint32_t term_id) {
+            buffer.push_back(term_id);
+        });
+        return buffer;
+    }
+    return span(document_term_ids_).subspan(document_term_offsets_[document_index],
+                                            document_term_offsets_[document_index + 1]
+                                            - document_term_offsets_[document_index]);
+}
+
+uint64_t SearchServer::MixHash(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+size_t SearchServer::ChooseBandRows(double jaccard_threshold) {
+    size_t band_rows = 1;
+    for (size_t rows = 2; rows <= MIN_HASH_COUNT; rows *= 2) {
+        const double candidate_similarity = pow(1.0 * rows / MIN_HASH_COUNT, 1.0 / rows);
+        if (candidate_similarity > jaccard_threshold - 0.1) {
+            break;
+        }
+        band_rows = rows;
+    }
+    return band_rows;
+}
+
+void SearchServer::ComputeBandKeys(uint32_t document_index, size_t band_rows, span<uint32_t> keys) const {
+    // Функции MinHash — first + i * step от двух хэшей терма: одно перемешивание на терм вместо MIN_HASH_COUNT
+    array<uint64_t, MIN_HASH_COUNT> min_hashes;
+    min_hashes.fill(UINT64_MAX);
+    ForEachDocumentTerm(document_index, [&min_hashes](uint32_t term_id) {
+        uint64_t hash = MixHash(term_id + 0x9e3779b97f4a7c15ULL);
+        const uint64_t step = MixHash(hash ^ 0xd6e8feb86659fd93ULL) | 1;
+        for (uint64_t& min_hash : min_hashes) {
+            min_hash = min(min_hash, hash);
+            hash += step;
+        }
+    });
+    for (size_t band = 0; band < keys.size(); ++band) {
+        uint64_t key = band;
+        for (size_t row = 0; row < band_rows; ++row) {
+            key = MixHash(key ^ min_hashes[band * band_rows + row]);
+        }
+        keys[band] = static_cast<uint32_t>(key >> 32);
+    }
+}
+
+double SearchServer::ComputeJaccard(uint32_t lhs_document_index, uint32_t rhs_document_index) const {
+    vector<uint32_t> lhs_buffer;
+    vector<uint32_t> rhs_buffer;
+    const span<const uint32_t> lhs_terms = GetDocumentTerms(lhs_document_index, lhs_buffer);
+    const span<const uint32_t> rhs_terms = GetDocumentTerms(rhs_document_index, rhs_buffer);
+    size_t common_count = 0;
+    for (size_t lhs = 0, rhs = 0; lhs < lhs_terms.size() && rhs < rhs_terms.size();) {
+        if (lhs_terms[lhs] < rhs_terms[rhs]) {
+            ++lhs;
+        } else if (rhs_terms[rhs] < lhs_terms[lhs]) {
+            ++rhs;
+        } else {
+            ++common_count;
+            ++lhs;
+            ++rhs;
+        }
+    }
+    const size_t union_count = lhs_terms.size() + rhs_terms.size() - common_count;
+    // Пустые документы одинаковы
+    return union_count == 0 ? 1.0 : 1.0 * common_count / union_count;
 }
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    return (const map<basic_string_view<char>, double>&) documents_to_words_freqs_.at(document_id);
+    if (const auto it = documents_to_words_freqs_.find(document_id); it != documents_to_words_freqs_.end()) {
+        return it->second;
+    }
+    const auto snapshot_word_freqs = GetSnapshotWordFreqs(document_id);
+    lock_guard guard(snapshot_->mutex);
+    auto [it, inserted] = snapshot_->materialized_word_freqs.try_emplace(document_id);
+    if (inserted) {
+        for (const SnapshotWordFreq& word_freq : snapshot_word_freqs) {
+            it->second.emplace(terms_[word_freq.term_id].word, word_freq.term_freq);
+        }
+    }
+    return it->second;
 }
 
 _Rb_tree_const_iterator<int> SearchServer::begin() {
@@ -176,6 +473,276 @@ void SearchServer::RemoveDocument(int document_id) {
     SearchServer::RemoveDocument(std::execution::seq, document_id);
 }
 
+void SearchServer::RemoveDocuments(span<const int> document_ids) {
+    unordered_set<int> unique_ids;
+    for (const int document_id : document_ids) {
+        if (document_indexes_.count(document_id) == 0) {
+            throw out_of_range("Invalid document_id"s);
+        }
+        if (!unique_ids.insert(document_id).second) {
+            throw invalid_argument("Repeated document_id"s);
+        }
+    }
+    if (document_ids.empty()) {
+        return;
+    }
+    InstallMerge(false);
+    for (const int document_id : document_ids) {
+        const uint32_t document_index = document_indexes_.at(document_id);
+        if (duplicate_handling_ != DuplicateHandling::ALLOW) {
+            EraseSignature(document_index);
+        }
+        ForEachDocumentTerm(document_index, [this](uint32_t term_id) {
+            --terms_[term_id].document_count;
+        });
+        removed_documents_[document_index] = true;
+        segments_[FindSegment(document_index)]->MarkRemoved(1);
+        if (snapshot_ != nullptr) {
+            snapshot_->materialized_word_freqs.erase(document_id);
+        }
+        documents_to_words_freqs_.erase(document_id);
+        document_indexes_.erase(document_id);
+        document_ids_.erase(document_id);
+    }
+    ++corpus_epoch_;
+    ScheduleMerge();
+}
+
+void SearchServer::SetPostingsCompression(bool enabled) {
+    // Сегменты меняются на месте, поэтому фоновое слияние не должно их читать
+    WaitForMerges();
+    compressed_postings_ = enabled;
+    // Сжатые списки хранят TF с округлением, так что выдача, посчитанная до переключения, устаревает
+    ++corpus_epoch_;
+    for (size_t i = 0; i + 1 < segments_.size(); ++i) {
+        segments_[i]->SetCompression(enabled, executor_.get());
+    }
+    if (enabled && segments_.back()->GetDocumentCount() > 0) {
+        SealSegment();
+    }
+    ScheduleMerge();
+}
+
+void SearchServer::SetSegmentCapacity(size_t document_count) {
+    if (document_count == 0) {
+        throw invalid_argument("Segment capacity must be positive"s);
+    }
+    InstallMerge(false);
+    segment_capacity_ = document_count;
+    SealFullSegment();
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    return segments_.size();
+}
+
+void SearchServer::WaitForMerges() {
+    // Подставленное слияние может сразу запустить следующее, например для получившегося крупного сегмента
+    while (merge_) {
+        InstallMerge(true);
+    }
+}
+
+void SearchServer::SetRetrievalMode(RetrievalMode mode) {
+    retrieval_mode_ = mode;
+}
+
+void SearchServer::SetParallelSplit(ParallelSplit split) {
+    parallel_split_ = split;
+}
+
+void SearchServer::SetExecutor(shared_ptr<WorkStealingExecutor> executor) {
+    if (executor) {
+        executor_thresholds_ = CalibrateAdaptiveThresholds(executor.get());
+    }
+    executor_ = std::move(executor);
+}
+
+WorkStealingExecutor* SearchServer::GetExecutor() const {
+    return executor_.get();
+}
+
+size_t SearchServer::EstimateQueryWork(const QueryTerms& query) const {
+    size_t work = 0;
+    for (const auto* terms : {&query.plus_terms, &query.minus_terms}) {
+        for (const QueryTerm& term : *terms) {
+            work += terms_[term.term_id].document_count;
+        }
+    }
+    return work;
+}
+
+size_t SearchServer::GetParallelism() const {
+    return executor_ ? executor_->GetWorkerCount() + 1 : max(1u, thread::hardware_concurrency());
+}
+
+size_t SearchServer::ChooseAdaptiveParallelism(size_t work) const {
+    return ChooseParallelism(work, GetParallelism(), executor_ ? executor_thresholds_ : GetAdaptiveThresholds());
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+    query_cache_ = capacity == 0 ? nullptr : make_unique<QueryCache>(capacity);
+}
+
+void SearchServer::SetDuplicateHandling(DuplicateHandling handling, DuplicateHandler handler) {
+    duplicate_handler_ = std::move(handler);
+    if (handling == DuplicateHandling::ALLOW) {
+        signature_index_.clear();
+    } else if (duplicate_handling_ == DuplicateHandling::ALLOW) {
+        signature_index_.reserve(document_indexes_.size());
+        for (const auto& [document_id, document_index] : document_indexes_) {
+            InsertSignature(document_index);
+        }
+    }
+    duplicate_handling_ = handling;
+}
+
+QueryCache::Stats SearchServer::GetQueryCacheStats() const {
+    return query_cache_ ? query_cache_->GetStats() : QueryCache::Stats{};
+}
+
+void SearchServer::SetCorpusStatistics(const CorpusStatistics* statistics) {
+    // Эпохи разных статистик несравнимы, поэтому прежние IDF и выдача сбрасываются в любом случае.
+    // Эпоха корпуса продолжает расти от текущей, даже если у новой статистики эпоха меньше
+    const uint64_t epoch = GetCorpusEpoch() + 1;
+    corpus_statistics_ = statistics;
+    for (const TermData& term : terms_) {
+        term.inverse_document_freq.statistics_word_id.store(CorpusStatistics::NO_WORD, memory_order_relaxed);
+    }
+    corpus_epoch_ = epoch - (corpus_statistics_ == nullptr ? 0 : corpus_statistics_->GetEpoch());
+}
+
+// Порядок записей должен совпадать с OpenSnapshot, при его изменении повышается SNAPSHOT_VERSION
+void SearchServer::SaveSnapshot(const string& path) const {
+    SnapshotWriter writer(path);
+    writer.WriteStrings({stop_words_.begin(), stop_words_.end()});
+    writer.WriteValue<uint64_t>(compressed_postings_);
+
+    vector<string_view> words;
+    words.reserve(terms_.size());
+    for (const TermData& term : terms_) {
+        words.push_back(term.word);
+    }
+    writer.WriteStrings(words);
+    // Сегментов в снимке нет: списки терма из всех сегментов сливаются в один без удалённых документов
+    vector<const PostingList*> lists;
+    for (uint32_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        lists.clear();
+        bool has_removed = false;
+        for (const auto& segment : segments_) {
+            if (const PostingList* postings = segment->FindPostings(term_id)) {
+                lists.push_back(postings);
+                has_removed = has_removed || segment->GetRemovedDocumentCount() > 0;
+            }
+        }
+        if (lists.size() == 1 && !has_removed && lists[0]->IsCompressed() == compressed_postings_) {
+            lists[0]->Save(writer);
+        } else {
+            IndexSegment::MergePostings(lists, removed_documents_, 0, compressed_postings_).Save(writer);
+        }
+    }
+
+    writer.WriteArray<DocumentData>(documents_);
+    vector<int> document_ids;
+    vector<uint32_t> document_indexes;
+    vector<uint64_t> word_freq_offsets;
+    vector<SnapshotWordFreq> word_freqs;
+    for (const auto& [document_id, document_index] : document_indexes_) {
+        document_ids.push_back(document_id);
+        document_indexes.push_back(document_index);
+        word_freq_offsets.push_back(word_freqs.size());
+        if (const auto it = documents_to_words_freqs_.find(document_id); it != documents_to_words_freqs_.end()) {
+            const size_t first = word_freqs.size();
+            for (const auto& [word, term_freq] : it->second) {
+                word_freqs.push_back({term_ids_.at(word), 0, term_freq});
+            }
+            sort(word_freqs.begin() + static_cast<ptrdiff_t>(first), word_freqs.end(),
+                 [](const SnapshotWordFreq& lhs, const SnapshotWordFreq& rhs) {
+                     return lhs.term_id < rhs.term_id;
+                 });
+        } else {
+            const auto snapshot_word_freqs = GetSnapshotWordFreqs(document_id);
+            word_freqs.insert(word_freqs.end(), snapshot_word_freqs.begin(), snapshot_word_freqs.end());
+        }
+    }
+    word_freq_offsets.push_back(word_freqs.size());
+    writer.WriteArray<int>(document_ids);
+    writer.WriteArray<uint32_t>(document_indexes);
+    writer.WriteArray<uint64_t>(word_freq_offsets);
+    writer.WriteArray<SnapshotWordFreq>(word_freqs);
+    writer.Finish();
+}
+
+SearchServer SearchServer::OpenSnapshot(const string& path, bool verify_checksum) {
+    auto snapshot = make_unique<SnapshotStorage>(path);
+    SnapshotReader reader(snapshot->file, verify_checksum);
+    SearchServer server(reader.ReadStrings());
+    server.compressed_postings_ = reader.ReadValue<uint64_t>() != 0;
+
+    const auto words = reader.ReadStrings();
+    server.terms_.reserve(words.size());
+    server.term_ids_.reserve(words.size());
+    vector<uint32_t> segment_term_ids;
+    vector<PostingList> segment_postings;
+    for (const string_view word : words) {
+        const auto term_id = static_cast<uint32_t>(server.terms_.size());
+        server.term_ids_.emplace(word, term_id);
+        PostingList postings = PostingList::Map(reader);
+        server.terms_.push_back(TermData{word, postings.size(), {}});
+        if (!postings.empty()) {
+            segment_term_ids.push_back(term_id);
+            segment_postings.push_back(std::move(postings));
+        }
+    }
+
+    const auto documents = reader.ReadArray<DocumentData>();
+    server.documents_.assign(documents.begin(), documents.end());
+    const auto document_ids = reader.ReadArray<int>();
+    const auto document_indexes = reader.ReadArray<uint32_t>();
+    snapshot->document_ids = document_ids;
+    snapshot->word_freq_offsets = reader.ReadArray<uint64_t>();
+    snapshot->word_freqs = reader.ReadArray<SnapshotWordFreq>();
+
+    // Контрольная сумма ловит случайную порчу, но её можно не проверять, поэтому каждый индекс документа
+    // и id терма, которые потом идут в индексацию массивов, проверяется на границы и порядок и здесь
+    const auto& offsets = snapshot->word_freq_offsets;
+    const auto& word_freqs = snapshot->word_freqs;
+    bool consistent = reader.AtEnd() && server.term_ids_.size() == words.size()
+                      && documents.size() < numeric_limits<uint32_t>::max()
+                      && document_indexes.size() == document_ids.size() && offsets.size() == document_ids.size() + 1
+                      && offsets.back() == word_freqs.size();
+    for (size_t i = 0; consistent && i < document_ids.size(); ++i) {
+        consistent = (i == 0 || document_ids[i - 1] < document_ids[i]) && document_indexes[i] < documents.size()
+                     && documents[document_indexes[i]].id == document_ids[i] && offsets[i] <= offsets[i + 1];
+        for (uint64_t j = offsets[i]; consistent && j < offsets[i + 1]; ++j) {
+            consistent = word_freqs[j].term_id < words.size()
+                         && (j == offsets[i] || word_freqs[j - 1].term_id < word_freqs[j].term_id);
+        }
+    }
+    for (size_t i = 0; consistent && i < segment_postings.size(); ++i) {
+        consistent = segment_postings[i].HasValidDocumentIndexes(static_cast<uint32_t>(documents.size()));
+    }
+    if (!consistent) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+
+    server.removed_documents_.assign(documents.size(), true);
+    server.document_term_offsets_.assign(documents.size() + 1, 0);
+    snapshot->document_count = documents.size();
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        server.document_indexes_.emplace_hint(server.document_indexes_.end(), document_ids[i], document_indexes[i]);
+        server.document_ids_.emplace_hint(server.document_ids_.end(), document_ids[i]);
+        server.removed_documents_[document_indexes[i]] = false;
+    }
+    // Весь снимок становится одним запечатанным сегментом, удалённых документов в его списках нет
+    const auto document_count = static_cast<uint32_t>(documents.size());
+    server.segments_ = {make_shared<IndexSegment>(0, document_count, document_ids.size(), std::move(segment_term_ids),
+                                                  std::move(segment_postings)),
+                        make_shared<IndexSegment>(document_count)};
+    server.snapshot_ = std::move(snapshot);
+    return server;
+}
+
 bool SearchServer::IsStopWord(string_view word) const {
     return stop_words_.count(word) > 0;
 }
@@ -219,6 +786,59 @@ vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view& text)
     return words;
 }
 
+void SearchServer::CheckNewDocumentIds(span<const NewDocument> documents) const {
+    unordered_set<int> new_ids;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0 || document_indexes_.count(document.id) > 0 || !new_ids.insert(document.id).second) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+}
+
+span<const SearchServer::SnapshotWordFreq> SearchServer::GetSnapshotWordFreqs(int document_id) const {
+    if (snapshot_ == nullptr || document_indexes_.count(document_id) == 0) {
+        throw out_of_range("Invalid document_id"s);
+    }
+    const auto& document_ids = snapshot_->document_ids;
+    const auto& offsets = snapshot_->word_freq_offsets;
+    const size_t position = lower_bound(document_ids.begin(), document_ids.end(), document_id) - document_ids.begin();
+    return snapshot_->word_freqs.subspan(offsets[position], offsets[position + 1] - offsets[position]);
+}
+
+SearchServer::PartialIndex SearchServer::BuildPartialIndex(span<const NewDocument> documents,
+                                                           uint32_t first_document_index) const {
+    PartialIndex partial_index;
+    unordered_map<string_view, uint32_t> word_numbers;
+    // Исключение внутри параллельного алгоритма завершило бы программу, поэтому оно передаётся наружу
+    try {
+        partial_index.word_freqs.reserve(documents.size());
+        for (size_t number = 0; number < documents.size(); ++number) {
+            auto words = SplitIntoWordsNoStop(documents[number].text);
+            sort(words.begin(), words.end());
+            const double inv_word_count = 1.0 / words.size();
+            const auto document_index = first_document_index + static_cast<uint32_t>(number);
+            auto& word_freqs = partial_index.word_freqs.emplace_back();
+            for (auto it = words.begin(); it != words.end();) {
+                const auto [word_number, inserted] = word_numbers.try_emplace(*it, partial_index.words.size());
+                if (inserted) {
+                    partial_index.words.push_back(*it);
+                    partial_index.postings.emplace_back();
+                }
+                // TF складывается из тех же слагаемых, что и в AddDocument, поэтому совпадает до бита
+                double term_freq = 0;
+                for (const string_view word = *it; it != words.end() && *it == word; ++it) {
+                    term_freq += inv_word_count;
+                }
+                word_freqs.emplace_back(word_number->second, term_freq);
+                partial_index.postings[word_number->second].emplace_back(document_index, term_freq);
+            }
+        }
+    } catch (...) {
+        partial_index.error = current_exception();
+    }
+    return partial_index;
+}
+
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     if (ratings.empty()) {
         return 0;
@@ -267,8 +887,179 @@ SearchServer::Query_for_par SearchServer::ParseQueryForPar(string_view text) con
     return result;
 }
 
+SearchServer::QueryTerms SearchServer::ResolveQuery(const Query_for_par& query) const {
+    return {FindQueryTerms(query.plus_words), FindQueryTerms(query.minus_words)};
+}
+
+QueryCache::Key SearchServer::MakeQueryCacheKey(const QueryTerms& query, DocumentStatus status,
+                                                size_t top_count) const {
+    // Слов без документов в запросе уже нет: до смены поколения они ни на что не влияют
+    const auto to_term_ids = [](const vector<QueryTerm>& terms) {
+        vector<uint32_t> term_ids;
+        term_ids.reserve(terms.size());
+        for (const QueryTerm& term : terms) {
+            term_ids.push_back(term.term_id);
+        }
+        sort(term_ids.begin(), term_ids.end());
+        return term_ids;
+    };
+    QueryCache::Key key{to_term_ids(query.plus_terms), to_term_ids(query.minus_terms), status, top_count};
+    key.minus_terms.erase(unique(key.minus_terms.begin(), key.minus_terms.end()), key.minus_terms.end());
+    return key;
+}
+
+uint32_t SearchServer::InternTerm(string_view word) {
+    if (const auto it = term_ids_.find(word); it != term_ids_.end()) {
+        return it->second;
+    }
+    const auto term_id = static_cast<uint32_t>(terms_.size());
+    const string_view stored_word = words_.emplace_back(word);
+    terms_.push_back(TermData{stored_word, 0, {}});
+    term_ids_.emplace(stored_word, term_id);
+    return term_id;
+}
+
+const SearchServer::TermData* SearchServer::FindTerm(string_view word) const {
+    const auto it = term_ids_.find(word);
+    return it == term_ids_.end() ? nullptr : &terms_[it->second];
+}
+
+uint32_t SearchServer::GetTermId(const TermData& term) const {
+    return static_cast<uint32_t>(&term - terms_.data());
+}
+
+size_t SearchServer::FindSegment(uint32_t document_index) const {
+    const auto it = upper_bound(segments_.begin(), segments_.end(), document_index,
+                                [](uint32_t index, const shared_ptr<IndexSegment>& segment) {
+                                    return index < segment->FirstDocumentIndex();
+                                });
+    return it - segments_.begin() - 1;
+}
+
+void SearchServer::SealFullSegment() {
+    if (segments_.back()->GetDocumentCount() < segment_capacity_) {
+        return;
+    }
+    SealSegment();
+    ScheduleMerge();
+    // Если загрузка обгоняет слияния, сегментов становится всё больше и поиск замедляется,
+    // поэтому сверх предела запись ждёт слияния
+    if (segments_.size() > MAX_SEGMENT_COUNT) {
+        InstallMerge(true);
+    }
+}
+
+void SearchServer::SealSegment() {
+    segments_.back()->Seal(compressed_postings_, executor_.get());
+    segments_.push_back(make_shared<IndexSegment>(static_cast<uint32_t>(documents_.size())));
+}
+
+void SearchServer::ScheduleMerge() {
+    if (merge_) {
+        return;
+    }
+    // Ярус сегмента — порядок его размера: сегмент яруса t меньше segment_capacity_ * F^(t + 1) документов.
+    // Сливаются SEGMENT_MERGE_FACTOR соседних сегментов одного яруса, самые старые из таких,
+    // поэтому даже после отставания слияний сегменты остаются упорядочены по убыванию размера
+    const auto tier = [this](const IndexSegment& segment) {
+        size_t tier = 0;
+        for (size_t size = segment.GetLiveDocumentCount() / segment_capacity_; size >= SEGMENT_MERGE_FACTOR;
+             size /= SEGMENT_MERGE_FACTOR) {
+            ++tier;
+        }
+        return tier;
+    };
+    const size_t sealed_count = segments_.size() - 1;
+    size_t first = sealed_count;
+    size_t last = sealed_count;
+    for (size_t begin = 0; begin + SEGMENT_MERGE_FACTOR <= sealed_count && first == last; ++begin) {
+        const size_t begin_tier = tier(*segments_[begin]);
+        bool same_tier = true;
+        for (size_t i = begin + 1; same_tier && i < begin + SEGMENT_MERGE_FACTOR; ++i) {
+            same_tier = tier(*segments_[i]) == begin_tier;
+        }
+        if (same_tier) {
+            first = begin;
+            last = begin + SEGMENT_MERGE_FACTOR;
+        }
+    }
+    // Иначе переписывается сегмент, в котором удалена больше чем половина документов
+    for (size_t i = sealed_count; i-- > 0 && first == last;) {
+        if (segments_[i]->GetRemovedDocumentCount() * 2 > segments_[i]->GetDocumentCount()) {
+            first = i;
+            last = i + 1;
+        }
+    }
+    if (first == last) {
+        return;
+    }
+
+    auto merge = make_unique<SegmentMerge>();
+    merge->segments.assign(segments_.begin() + first, segments_.begin() + last);
+    merge->removed_document_count = 0;
+    size_t document_count = 0;
+    for (const auto& segment : merge->segments) {
+        merge->removed_document_count += segment->GetRemovedDocumentCount();
+        document_count += segment->GetLiveDocumentCount();
+    }
+    // Поток получает свои копии всего, что читает, кроме самих запечатанных сегментов, а они не меняются
+    vector<bool> removed(removed_documents_.begin() + merge->segments.front()->FirstDocumentIndex(),
+                         removed_documents_.begin() + merge->segments.back()->EndDocumentIndex());
+    vector<shared_ptr<const IndexSegment>> segments(merge->segments.begin(), merge->segments.end());
+    merge->result = async(launch::async, [segments = std::move(segments), removed = std::move(removed),
+                                          document_count, compress = compressed_postings_] {
+        vector<const IndexSegment*> sources;
+        for (const auto& segment : segments) {
+            sources.push_back(segment.get());
+        }
+        return IndexSegment::Merge(sources, removed, document_count, compress);
+    });
+    merge_ = std::move(merge);
+}
+
+void SearchServer::InstallMerge(bool wait) {
+    if (!merge_ || (!wait && merge_->result.wait_for(chrono::seconds(0)) != future_status::ready)) {
+        return;
+    }
+    const unique_ptr<SegmentMerge> merge = std::move(merge_);
+    auto merged = make_shared<IndexSegment>(merge->result.get());
+    // Документы, удалённые во время слияния, остались в его результате
+    size_t removed_document_count = 0;
+    for (const auto& segment : merge->segments) {
+        removed_document_count += segment->GetRemovedDocumentCount();
+    }
+    merged->MarkRemoved(removed_document_count - merge->removed_document_count);
+    const auto first = find(segments_.begin(), segments_.end(), merge->segments.front());
+    const auto position = segments_.erase(first, first + static_cast<ptrdiff_t>(merge->segments.size()));
+    segments_.insert(position, std::move(merged));
+    ScheduleMerge();
+}
+
+uint64_t SearchServer::GetCorpusEpoch() const {
+    return corpus_epoch_ + (corpus_statistics_ == nullptr ? 0 : corpus_statistics_->GetEpoch());
+}
+
 // Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(const TermData& term) const {
+    const InverseDocumentFreqCache& cache = term.inverse_document_freq;
+    const uint64_t epoch = GetCorpusEpoch();
+    if (cache.epoch.load(memory_order_acquire) != epoch) {
+        double inverse_document_freq;
+        if (corpus_statistics_ == nullptr) {
+            inverse_document_freq = log(GetDocumentCount() * 1.0 / term.document_count);
+        } else {
+            // Слово может попасть в статистику позже, чем в индекс, так что ненайденный номер ищется снова
+            size_t word_id = cache.statistics_word_id.load(memory_order_relaxed);
+            if (word_id == CorpusStatistics::NO_WORD) {
+                word_id = corpus_statistics_->FindWord(term.word);
+                cache.statistics_word_id.store(word_id, memory_order_relaxed);
+            }
+            inverse_document_freq = log(corpus_statistics_->GetDocumentCount() * 1.0
+                                        / corpus_statistics_->GetDocumentFrequency(word_id));
+        }
+        cache.value.store(inverse_document_freq, memory_order_relaxed);
+        cache.epoch.store(epoch, memory_order_release);
+    }
+    return cache.value.load(memory_order_relaxed);
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <string>
 #include <tuple>
@@ -8,14 +9,79 @@
 #include <cmath>
 #include <algorithm>
 #include <execution>
+#include <atomic>
 #include <deque>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <exception>
+#include <future>
+#include <functional>
+#include <optional>
 
 #include "string_processing.h"
+#include "adaptive_policy.h"
+#include "corpus_statistics.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "index_segment.h"
+#include "posting_list.h"
+#include "query_cache.h"
+#include "query_deadline.h"
+#include "snapshot.h"
+#include "score_accumulator.h"
+#include "top_documents.h"
+#include "work_stealing_executor.h"
 
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const int RELEVANCE_ERROR_RATE = 1e-6;
+// Столько документов копится в изменяемом сегменте, прежде чем он запечатывается
+const size_t DEFAULT_SEGMENT_CAPACITY = 4096;
+
+// EXHAUSTIVE считает релевантность всех документов запроса;
+// MAX_SCORE обходит списки по документам и пропускает те, что не могут попасть в выдачу (только для seq);
+// BLOCK_MAX_SCORE вдобавок оценивает вклад редких термов по максимумам блоков и не распаковывает лишние блоки
+enum class RetrievalMode {
+    EXHAUSTIVE,
+    MAX_SCORE,
+    BLOCK_MAX_SCORE,
+};
+
+// Как параллельный запрос делится между потоками:
+// BY_TERM раздаёт потокам слова запроса, так что запрос из одного-двух слов почти не ускоряется;
+// BY_DOCUMENT_RANGE делит индексы документов на диапазоны, и каждый поток считает все слова запроса
+// в своём диапазоне и собирает свою выдачу. Релевантность при этом совпадает с последовательным поиском до бита
+enum class ParallelSplit {
+    BY_TERM,
+    BY_DOCUMENT_RANGE,
+};
+
+// Что AddDocument и AddDocuments делают с документом, набор слов которого совпадает с набором уже добавленного:
+// ALLOW не проверяет наборы, REPORT добавляет документ и сообщает о совпадении, REJECT сообщает и не добавляет
+enum class DuplicateHandling {
+    ALLOW,
+    REPORT,
+    REJECT,
+};
+
+// Получает id нового документа и id уже добавленного документа с тем же набором слов
+using DuplicateHandler = function<void(int document_id, int original_id)>;
+
+// Результат запроса со сроком: complete == false, если срок истёк или запрос отменён до конца обхода,
+// и documents — лучшие из документов, которые успели оценить
+struct SearchResult {
+    vector<Document> documents;
+    bool complete;
+};
+
+// Документ для пакетной загрузки через AddDocuments; text должен жить до конца вызова
+struct NewDocument {
+    int id;
+    string_view text;
+    DocumentStatus status;
+    vector<int> ratings;
+};
 
 class SearchServer {
 public:
@@ -30,22 +96,101 @@ public:
 
     void AddDocument(int document_id, const string_view& document, DocumentStatus status, const vector<int>& ratings);
 
+    // Индекс получается тем же, что после AddDocument для каждого документа по порядку.
+    // При ошибке в любом документе исключение бросается до изменения индекса
+    template<typename Policy>
+    void AddDocuments(Policy policy, span<const NewDocument> documents);
+
+    void AddDocuments(span<const NewDocument> documents);
+
+    // top_count задаёт размер выдачи; передать его можно только вместе с предикатом или статусом
     template<typename Policy, typename DocumentPredicate>
-    vector<Document> FindTopDocuments(Policy policy, string_view raw_query, DocumentPredicate document_predicate) const;
+    vector<Document> FindTopDocuments(Policy policy, string_view raw_query, DocumentPredicate document_predicate,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template<typename Policy>
-    vector<Document> FindTopDocuments(Policy policy, string_view raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(Policy policy, string_view raw_query, DocumentStatus status,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template<typename Policy>
     vector<Document> FindTopDocuments(Policy policy, string_view raw_query) const;
 
     template<typename DocumentPredicate>
-    vector<Document> FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate) const;
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(string_view raw_query, DocumentStatus status,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     vector<Document> FindTopDocuments(string_view raw_query) const;
 
+    class PreparedQuery;
+
+    // Разбирает и проверяет запрос один раз и находит его термы вместе с IDF. Подготовленный запрос можно
+    // выполнять сколько угодно раз и из разных потоков; после изменения индекса термы и IDF находятся заново
+    // по сохранённым словам, без разбора строки
+    PreparedQuery PrepareQuery(string_view raw_query) const;
+
+    template<typename Policy, typename DocumentPredicate>
+    vector<Document> FindTopDocuments(Policy policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template<typename Policy>
+    vector<Document> FindTopDocuments(Policy policy, const PreparedQuery& query, DocumentStatus status,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template<typename Policy>
+    vector<Document> FindTopDocuments(Policy policy, const PreparedQuery& query) const;
+
+    template<typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status,
+                                      size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    vector<Document> FindTopDocuments(const PreparedQuery& query) const;
+
+    // Запрос выполняется на executor сервера, а без него или при заполненной очереди executor — через std::async,
+    // так что вызов не ждёт запроса. Запрос обращается к серверу по указателю,
+    // поэтому сервер нельзя удалять и перемещать, пока возвращённая future не готова.
+    // По истечении deadline или по stop_token обход прекращается между списками вхождений и отдаётся
+    // частичная выдача. Кэш выдачи эти запросы не используют
+    template<typename DocumentPredicate>
+    future<SearchResult> FindTopDocumentsAsync(string raw_query, chrono::steady_clock::time_point deadline,
+                                               DocumentPredicate document_predicate,
+                                               size_t top_count = MAX_RESULT_DOCUMENT_COUNT,
+                                               stop_token stop_token = {}) const;
+
+    future<SearchResult> FindTopDocumentsAsync(string raw_query, chrono::steady_clock::time_point deadline,
+                                               DocumentStatus status = DocumentStatus::ACTUAL,
+                                               size_t top_count = MAX_RESULT_DOCUMENT_COUNT,
+                                               stop_token stop_token = {}) const;
+
+    // Выдачи для пакета запросов. Запросы делятся на группы, и в группе список вхождений каждого слова обходится
+    // один раз для всех запросов, где оно есть, на любой позиции; вклады раскладываются по массивам очков запросов.
+    // Ищет полным перебором. Вклады в очки документа складываются в порядке id термов, а не слов запроса, поэтому,
+    // как у ParallelSplit::BY_TERM, релевантность может отличаться от FindTopDocuments в последних знаках.
+    // policy задаёт, выполняются ли группы параллельно; без неё — параллельно
+    template<typename Policy, typename DocumentPredicate>
+    vector<vector<Document>> FindTopDocumentsBatch(Policy policy, span<const string> raw_queries,
+                                                   DocumentPredicate document_predicate,
+                                                   size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template<typename Policy>
+    vector<vector<Document>> FindTopDocumentsBatch(Policy policy, span<const string> raw_queries,
+                                                   DocumentStatus status = DocumentStatus::ACTUAL,
+                                                   size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template<typename DocumentPredicate>
+    vector<vector<Document>> FindTopDocumentsBatch(span<const string> raw_queries,
+                                                   DocumentPredicate document_predicate,
+                                                   size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    vector<vector<Document>> FindTopDocumentsBatch(span<const string> raw_queries,
+                                                   DocumentStatus status = DocumentStatus::ACTUAL,
+                                                   size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
 
     int GetDocumentCount() const;
 
@@ -57,29 +202,209 @@ public:
     tuple<vector<string_view>, DocumentStatus>
     MatchDocument(execution::parallel_policy policy, string_view raw_query, int document_id) const;
 
+    // Запрос разбирается один раз, затем проверяется последовательно или параллельно по числу слов
+    tuple<vector<string_view>, DocumentStatus>
+    MatchDocument(AdaptivePolicy policy, string_view raw_query, int document_id) const;
+
+    // MatchDocument для каждого документа из document_ids: запрос разбирается и его слова находятся в словаре
+    // один раз, а документы проверяются параллельно. Неизвестный id бросает out_of_range до начала проверки
+    template<typename Policy>
+    vector<tuple<vector<string_view>, DocumentStatus>>
+    MatchDocuments(Policy policy, string_view raw_query, span<const int> document_ids) const;
+
+    vector<tuple<vector<string_view>, DocumentStatus>>
+    MatchDocuments(string_view raw_query, span<const int> document_ids) const;
+
     const map<string_view, double>& GetWordFrequencies(int document_id) const;
 
     _Rb_tree_const_iterator<int> begin();
 
     _Rb_tree_const_iterator<int> end();
 
+    // Индекс удалённого документа не освобождается: слияние сегментов убирает его вхождения, но documents_,
+    // removed_documents_ и прямой индекс по-прежнему хранят его запись, а массивы очков поиска выделяются
+    // на все когда-либо добавленные документы и остаются в пуле потока. При постоянной смене документов
+    // память растёт с числом добавлений, а не с числом живых документов; уплотнить индекс можно только
+    // пересозданием сервера
     void RemoveDocument(int document_id);
 
     template<typename P>
     void RemoveDocument(P policy, int document_id);
 
+    // Удаляет документы одним проходом: поколение индекса меняется и слияние планируется один раз.
+    // Неизвестный или повторённый id бросает исключение до изменения индекса
+    void RemoveDocuments(span<const int> document_ids);
+
+    // id документов, набор слов которых совпадает с набором слов документа с меньшим id, по возрастанию.
+    // Наборы сравниваются по 128-битным сигнатурам, которые считаются параллельно, а совпавшие сигнатуры
+    // проверяются точно
+    template<typename Policy>
+    vector<int> FindDuplicateDocuments(Policy policy) const;
+
+    // Группы похожих документов по возрастанию id, каждая из двух и больше документов. Группа — связные пары
+    // документов, у которых коэффициент Жаккара наборов слов не ниже jaccard_threshold из (0, 1].
+    // Пары-кандидаты дают MinHash-сигнатуры и LSH по полосам, так что работа почти линейна по числу документов,
+    // а похожесть кандидатов проверяется точно. Пара с похожестью около порога может быть пропущена
+    template<typename Policy>
+    vector<vector<int>> FindNearDuplicateDocuments(Policy policy, double jaccard_threshold) const;
+
+    // При REPORT и REJECT сервер ведёт индекс сигнатур наборов слов, и совпадение с уже добавленным документом
+    // ищется за ожидаемое O(1) обращений к нему; документы одного пакета AddDocuments сравниваются и между собой.
+    // Включение строит индекс по текущим документам, ALLOW его удаляет
+    void SetDuplicateHandling(DuplicateHandling handling, DuplicateHandler handler = {});
+
+    // Сжатые списки вхождений занимают в разы меньше памяти, но хранят TF с точностью до 1e-5.
+    // Сжимаются только запечатанные сегменты; при включении изменяемый сегмент запечатывается сразу,
+    // поэтому включать сжатие удобно после загрузки документов
+    void SetPostingsCompression(bool enabled);
+
+    // Новые документы дописываются в небольшой изменяемый сегмент, а заполненный сегмент запечатывается.
+    // Запечатанные сегменты сливаются в фоновом потоке, результат слияния подставляется при следующем
+    // изменении индекса. На выдачу разбиение на сегменты не влияет
+    void SetSegmentCapacity(size_t document_count);
+
+    size_t GetSegmentCount() const;
+
+    // Дожидается фоновых слияний сегментов и подставляет их результат
+    void WaitForMerges();
+
+    void SetRetrievalMode(RetrievalMode mode);
+
+    void SetParallelSplit(ParallelSplit split);
+
+    // Параллельные части запросов и пакетной загрузки выполняются на executor вместо пула стандартной библиотеки,
+    // и его размер ограничивает число занятых ядер. Один executor можно отдать нескольким серверам;
+    // nullptr возвращает стандартный пул. Пороги adaptive_execution для executor замеряются здесь же, а не на запросе
+    void SetExecutor(shared_ptr<WorkStealingExecutor> executor);
+
+    WorkStealingExecutor* GetExecutor() const;
+
+    // Кэш выдачи запросов с фильтром по статусу, capacity == 0 выключает его.
+    // Запросы с произвольным предикатом не кэшируются: предикат нельзя сравнить
+    void SetQueryCacheCapacity(size_t capacity);
+
+    QueryCache::Stats GetQueryCacheStats() const;
+
+    // IDF считается по общей статистике нескольких индексов вместо собственной; nullptr возвращает собственную.
+    // Статистика должна жить дольше сервера, и её изменения видны ему сразу
+    void SetCorpusStatistics(const CorpusStatistics* statistics);
+
+    // Сохраняет индекс целиком: стоп-слова, словарь, списки вхождений, прямой индекс и документы
+    void SaveSnapshot(const string& path) const;
+
+    // Открывает снимок через mmap. Списки вхождений и прямой индекс читаются прямо из файла,
+    // а таблицы поиска по словам и id документов строятся в памяти. Все индексы документов и id термов
+    // проверяются на границы и при открытии без verify_checksum, поэтому файл прочитывается целиком в любом случае;
+    // контрольная сумма дополнительно ловит порчу TF и строк. Повреждённый снимок бросает runtime_error
+    static SearchServer OpenSnapshot(const string& path, bool verify_checksum = true);
+
 private:
 
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
     };
 
+    // IDF терма для эпохи корпуса epoch. Константные запросы идут параллельно и пересчитывают кэш сами,
+    // поэтому поля атомарные: в пределах одной эпохи все пишут одно и то же значение
+    struct InverseDocumentFreqCache {
+        mutable atomic<uint64_t> epoch = UINT64_MAX;
+        mutable atomic<double> value = 0;
+        // Номер слова в общей статистике: по строке он ищется один раз, а не при каждом пересчёте
+        mutable atomic<size_t> statistics_word_id = CorpusStatistics::NO_WORD;
+
+        InverseDocumentFreqCache() = default;
+
+        InverseDocumentFreqCache(const InverseDocumentFreqCache& other) noexcept
+                : epoch(other.epoch.load()), value(other.value.load()),
+                  statistics_word_id(other.statistics_word_id.load()) {
+        }
+    };
+
+    struct TermData {
+        string_view word;
+        // Неудалённые документы со словом; списки вхождений лежат в сегментах
+        size_t document_count = 0;
+        InverseDocumentFreqCache inverse_document_freq;
+    };
+
+    // Фоновое слияние сегментов segments, которые пока остаются в segments_
+    struct SegmentMerge {
+        vector<shared_ptr<IndexSegment>> segments;
+        // Сумма счётчиков удалённых документов сегментов на момент запуска: эти документы в результат не попадут
+        size_t removed_document_count;
+        future<IndexSegment> result;
+    };
+
+    static constexpr size_t SEGMENT_MERGE_FACTOR = 4;
+    static constexpr size_t MAX_SEGMENT_COUNT = 32;
+
+    // Запись прямого индекса в снимке; записи документа идут по возрастанию id термов
+    struct SnapshotWordFreq {
+        uint32_t term_id;
+        uint32_t reserved;
+        double term_freq;
+    };
+
+    // Открытый снимок и та часть прямого индекса, которая читается прямо из него
+    struct SnapshotStorage {
+        explicit SnapshotStorage(const string& path)
+                : file(path) {
+        }
+
+        MappedFile file;
+        // Документы с меньшими индексами открыты из снимка
+        size_t document_count = 0;
+        span<const int> document_ids;
+        span<const uint64_t> word_freq_offsets;
+        span<const SnapshotWordFreq> word_freqs;
+        // GetWordFrequencies отдаёт map, поэтому она собирается при первом обращении к документу
+        std::mutex mutex;
+        map<int, map<string_view, double>> materialized_word_freqs;
+    };
+
     const set<string, less<>> stop_words_;
-    map<string, map<int, double>> word_to_document_freqs_;
-    map<int, map<string, double>> documents_to_words_freqs_;
-    map<int, DocumentData> documents_;
+    bool compressed_postings_ = false;
+    // Меняется при каждом добавлении и удалении документа и делает недействительными кэши IDF и выдачи.
+    // С общей статистикой это сдвиг от её эпохи и может переполняться: важна только сумма в GetCorpusEpoch
+    uint64_t corpus_epoch_ = 0;
+    const CorpusStatistics* corpus_statistics_ = nullptr;
+    unique_ptr<QueryCache> query_cache_;
+    DuplicateHandling duplicate_handling_ = DuplicateHandling::ALLOW;
+    DuplicateHandler duplicate_handler_;
+    // Младшая половина сигнатуры набора термов документа -> старшая половина и индекс документа.
+    // Ведётся только при DuplicateHandling, отличном от ALLOW
+    unordered_multimap<uint64_t, pair<uint64_t, uint32_t>> signature_index_;
+    RetrievalMode retrieval_mode_ = RetrievalMode::EXHAUSTIVE;
+    ParallelSplit parallel_split_ = ParallelSplit::BY_DOCUMENT_RANGE;
+    shared_ptr<WorkStealingExecutor> executor_;
+    // Пороги adaptive_execution, замеренные на executor_ при его установке
+    AdaptiveThresholds executor_thresholds_{};
+    // Слова хранятся в deque, чтобы string_view на них не инвалидировались при добавлении
+    deque<string> words_;
+    unordered_map<string_view, uint32_t> term_ids_;
+    vector<TermData> terms_;
+    // Сегменты по возрастанию индексов документов; последний не запечатан и принимает новые документы
+    vector<shared_ptr<IndexSegment>> segments_;
+    size_t segment_capacity_ = DEFAULT_SEGMENT_CAPACITY;
+    // Удалённые документы остаются в списках запечатанных сегментов до их слияния и пропускаются при поиске
+    vector<bool> removed_documents_;
+    // Документы, открытые из снимка, сюда не попадают, их частоты лежат в snapshot_
+    map<int, map<string_view, double>> documents_to_words_freqs_;
+    // Тот же прямой индекс по индексам документов: термы документа по возрастанию id лежат в document_term_ids_
+    // с document_term_offsets_[i] до document_term_offsets_[i + 1]. Документы из снимка здесь пустые,
+    // а записи удалённых остаются, как и сами documents_
+    vector<uint32_t> document_term_ids_;
+    vector<uint64_t> document_term_offsets_{0};
+    unique_ptr<SnapshotStorage> snapshot_;
+    // Индекс документа выдаётся по порядку добавления, по нему адресуются documents_ и списки вхождений.
+    // Индексы не переиспользуются и не сдвигаются, см. RemoveDocument
+    vector<DocumentData> documents_;
+    map<int, uint32_t> document_indexes_;
     set<int, less<>> document_ids_;
+    // Объявлено после snapshot_ и разрушается раньше него: фоновое слияние может читать отображённый файл
+    unique_ptr<SegmentMerge> merge_;
 
     bool IsStopWord(string_view word) const;
 
@@ -91,6 +416,26 @@ private:
 
     static int ComputeAverageRating(const vector<int>& ratings);
 
+    using PartialPostings = vector<pair<uint32_t, double>>;
+
+    // Часть пакета, разобранная одним потоком. Слова — string_view на тексты пакета,
+    // документы ссылаются на них по номерам внутри части
+    struct PartialIndex {
+        vector<string_view> words;
+        vector<PartialPostings> postings;
+        // Номера слов документа с их TF, по возрастанию слов
+        vector<vector<pair<uint32_t, double>>> word_freqs;
+        // id термов для words, заполняются при слиянии
+        vector<uint32_t> term_ids;
+        exception_ptr error;
+    };
+
+    void CheckNewDocumentIds(span<const NewDocument> documents) const;
+
+    span<const SnapshotWordFreq> GetSnapshotWordFreqs(int document_id) const;
+
+    PartialIndex BuildPartialIndex(span<const NewDocument> documents, uint32_t first_document_index) const;
+
     struct QueryWord {
         basic_string_view<char> data;
         bool is_minus;
@@ -113,12 +458,224 @@ private:
 
     Query_for_par ParseQueryForPar(string_view text) const;
 
-    double ComputeWordInverseDocumentFreq(const string& word) const;
+    // ParseQueryForPar без подряд идущих повторов и с проверкой запроса
+    template<typename Policy>
+    Query_for_par ParseSearchQuery(Policy policy, string_view raw_query) const;
+
+    // MatchDocument по уже разобранному запросу: слова в выдаче по возрастанию и без повторов
+    template<typename Policy>
+    tuple<vector<string_view>, DocumentStatus>
+    MatchParsedQuery(Policy policy, const Query_for_par& query, int document_id) const;
+
+    struct QueryTerm {
+        uint32_t term_id;
+        double inverse_document_freq;
+    };
+
+    // Термы в порядке слов запроса, без слов, которых нет ни в одном документе
+    struct QueryTerms {
+        vector<QueryTerm> plus_terms;
+        vector<QueryTerm> minus_terms;
+    };
+
+    QueryTerms ResolveQuery(const Query_for_par& query) const;
+
+    // Плюс-термы сортируются с сохранением повторов: повторное слово учитывается в релевантности дважды
+    QueryCache::Key MakeQueryCacheKey(const QueryTerms& query, DocumentStatus status, size_t top_count) const;
+
+    // Ограничения одного поиска
+    struct SearchLimits {
+        // Число параллельных задач, 0 — по числу потоков
+        size_t parallelism = 0;
+        const QueryDeadline* deadline = nullptr;
+
+        bool Expired() const {
+            return deadline != nullptr && deadline->Expired();
+        }
+    };
+
+    // Массивы очков группы запросов в FindTopDocumentsBatch занимают не больше этого, но в группе не больше
+    // MAX_BATCH_QUERY_COUNT запросов
+    static constexpr size_t BATCH_ACCUMULATOR_BYTES = 64 << 20;
+    static constexpr size_t MAX_BATCH_QUERY_COUNT = 8;
+
+    // FindTopDocumentsBatch по уже найденным в словаре запросам; AdaptivePolicy здесь уже заменена на seq или par
+    template<typename Policy, typename DocumentPredicate>
+    vector<vector<Document>> FindTopDocumentsBatch(Policy policy, const vector<QueryTerms>& queries,
+                                                   DocumentPredicate& document_predicate, size_t top_count) const;
+
+    // Между проверками срока в MaxScore обходится столько кандидатов
+    static constexpr size_t DEADLINE_CHECK_INTERVAL = 1024;
+
+    // Обход списков по документам в разы дороже накопления по термам и окупается, только если списки основных
+    // термов хотя бы во столько раз короче всех списков запроса. Это проверяется через каждые
+    // PRUNING_CHECK_INTERVAL кандидатов, и если отсечение не окупается, следующие TERM_AT_A_TIME_RANGE_SIZE
+    // документов считаются по термам, после чего порог выше и проверка повторяется
+    static constexpr size_t MIN_PRUNED_POSTINGS_RATIO = 8;
+    static constexpr size_t PRUNING_CHECK_INTERVAL = 256;
+    static constexpr uint32_t TERM_AT_A_TIME_RANGE_SIZE = 4096;
 
     template<typename Policy, typename DocumentPredicate>
-    vector<Document> FindAllDocuments(Policy policy, const Query_for_par& query, DocumentPredicate document_predicate) const;
+    vector<Document> FindTopDocuments(Policy policy, const QueryTerms& query, DocumentPredicate document_predicate,
+                                      size_t top_count, SearchLimits limits = {}) const;
+
+    // Сколько вхождений списков придётся обойти для запроса
+    size_t EstimateQueryWork(const QueryTerms& query) const;
 
-    bool IsWordInDocument(int document_id, const string& word) const;
+    uint32_t InternTerm(string_view word);
+
+    const TermData* FindTerm(string_view word) const;
+
+    uint32_t GetTermId(const TermData& term) const;
+
+    // Позиция в segments_ сегмента, которому принадлежит документ
+    size_t FindSegment(uint32_t document_index) const;
+
+    // Запечатывает изменяемый сегмент, если в нём набралось segment_capacity_ документов
+    void SealFullSegment();
+
+    void SealSegment();
+
+    // Запускает слияние, если его нет в работе и политика находит подходящие сегменты
+    void ScheduleMerge();
+
+    // Подставляет результат готового слияния, при wait дожидаясь его
+    void InstallMerge(bool wait);
+
+    // corpus_epoch_ вместе с эпохой общей статистики. Между вызовами SetCorpusStatistics обе только растут,
+    // а при смене статистики corpus_epoch_ пересчитывается так, чтобы сумма выросла, поэтому она не повторяется
+    uint64_t GetCorpusEpoch() const;
+
+    double ComputeWordInverseDocumentFreq(const TermData& term) const;
+
+    template<typename Policy, typename DocumentPredicate>
+    vector<Document> FindAllDocuments(Policy policy, const QueryTerms& query, DocumentPredicate document_predicate,
+                                      const SearchLimits& limits) const;
+
+    // Раскладывает термы запроса по group_count группам с примерно равной суммарной длиной списков
+    vector<vector<QueryTerm>> GroupTermsForWorkers(const vector<QueryTerm>& terms, size_t group_count) const;
+
+    vector<QueryTerm> FindQueryTerms(const vector<string_view>& words) const;
+
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double max_score;
+        size_t posting_count;
+    };
+
+    // Курсоры по спискам сегмента в порядке terms, без термов, которых в сегменте нет
+    vector<TermCursor> MakeTermCursors(const IndexSegment& segment, const vector<QueryTerm>& terms) const;
+
+    template<typename DocumentPredicate>
+    vector<Document> FindTopDocumentsMaxScore(const QueryTerms& query, DocumentPredicate document_predicate,
+                                              size_t top_count, const SearchLimits& limits) const;
+
+    // false, если обход прерван по сроку
+    template<typename DocumentPredicate>
+    bool FindSegmentTopDocumentsMaxScore(const IndexSegment& segment, const vector<QueryTerm>& plus_terms,
+                                         const vector<QueryTerm>& minus_terms, DocumentPredicate& document_predicate,
+                                         TopDocuments& top, const SearchLimits& limits) const;
+
+    // Сколько потоков выполняют параллельные части: исполнители executor_ вместе с вызывающим или все ядра
+    size_t GetParallelism() const;
+
+    // ChooseParallelism с порогами того пути, которым пойдут параллельные задачи
+    size_t ChooseAdaptiveParallelism(size_t work) const;
+
+    // Диапазон меньше этого на поток не выделяется
+    static constexpr size_t MIN_DOCUMENT_RANGE_SIZE = 2048;
+
+    template<typename Policy, typename DocumentPredicate>
+    vector<Document> FindTopDocumentsByDocumentRanges(Policy policy, const QueryTerms& query,
+                                                      DocumentPredicate document_predicate, size_t top_count,
+                                                      const SearchLimits& limits) const;
+
+    // Выдача документов [first_document_index, end_document_index), посчитанная по термам в массиве очков.
+    // false, если обход прерван по сроку
+    template<typename DocumentPredicate>
+    bool FindRangeTopDocuments(const vector<QueryTerm>& plus_terms, const vector<QueryTerm>& minus_terms,
+                               uint32_t first_document_index, uint32_t end_document_index,
+                               DocumentPredicate& document_predicate, TopDocuments& top,
+                               const SearchLimits& limits) const;
+
+    // Вызывает function(индекс документа, TF) для вхождений терма с индексами из [first_document_index, end_document_index)
+    template<typename Function>
+    void ForEachPosting(uint32_t term_id, uint32_t first_document_index, uint32_t end_document_index,
+                        Function function) const;
+
+    template<typename DocumentPredicate>
+    void AccumulateTermScores(const QueryTerm& term, uint32_t first_document_index, uint32_t end_document_index,
+                              DocumentPredicate& document_predicate, ScoreAccumulator& accumulator) const;
+
+    // Двоичный поиск по термам документа
+    bool IsWordInDocument(uint32_t document_index, const TermData& term) const;
+
+    // Вызывает function(id терма) для термов документа по возрастанию id
+    template<typename Function>
+    void ForEachDocumentTerm(uint32_t document_index, Function function) const;
+
+    // Сигнатура набора термов документа, не зависящая от их порядка
+    struct DocumentSignature {
+        uint64_t low;
+        uint64_t high;
+
+        auto operator<=>(const DocumentSignature& other) const = default;
+    };
+
+    DocumentSignature ComputeDocumentSignature(uint32_t document_index) const;
+
+    static void AddTermToSignature(DocumentSignature& signature, uint32_t term_id);
+
+    void InsertSignature(uint32_t document_index);
+
+    void EraseSignature(uint32_t document_index);
+
+    // id документа с набором слов words (по возрастанию, без повторов) из индекса сигнатур
+    optional<int> FindDocumentWithWords(const vector<string_view>& words) const;
+
+    // Сообщает обработчику о совпадении; false, если документ не нужно добавлять
+    bool HandleDuplicate(int document_id, int original_id) const;
+
+    // Номера документов пакета, которые нужно добавить
+    vector<size_t> CheckDuplicates(span<const NewDocument> documents) const;
+
+    template<typename Policy>
+    void AddNewDocuments(Policy policy, span<const NewDocument> documents);
+
+    bool HaveSameTerms(uint32_t lhs_document_index, uint32_t rhs_document_index) const;
+
+    // Термы документа по возрастанию id; термы документа из снимка копируются в buffer
+    span<const uint32_t> GetDocumentTerms(uint32_t document_index, vector<uint32_t>& buffer) const;
+
+    static uint64_t MixHash(uint64_t value);
+
+    static constexpr size_t MIN_HASH_COUNT = 128;
+
+    // Число строк в полосе LSH: вероятность стать кандидатами растёт круто около (1 / полос) ^ (1 / строк),
+    // и эта точка выбирается заметно ниже порога, чтобы пропусков было мало
+    static size_t ChooseBandRows(double jaccard_threshold);
+
+    // Ключи полос MinHash-сигнатуры документа, по одному на каждые band_rows значений
+    void ComputeBandKeys(uint32_t document_index, size_t band_rows, span<uint32_t> keys) const;
+
+    double ComputeJaccard(uint32_t lhs_document_index, uint32_t rhs_document_index) const;
+};
+
+// Запрос, подготовленный SearchServer::PrepareQuery. Копии делят один текст запроса и дёшевы
+class SearchServer::PreparedQuery {
+private:
+    friend class SearchServer;
+
+    PreparedQuery() = default;
+
+    // Слова query_ ссылаются на text_
+    shared_ptr<const string> text_;
+    Query_for_par query_;
+    // Сервер и эпоха корпуса, для которых найдены terms_
+    const SearchServer* server_ = nullptr;
+    uint64_t epoch_ = 0;
+    QueryTerms terms_;
 };
 
 template<typename StringContainer>
@@ -128,50 +685,87 @@ SearchServer::SearchServer(const StringContainer& stop_words)
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw invalid_argument("Some of stop words are invalid"s);
     }
+    segments_.push_back(make_shared<IndexSegment>(0));
 }
 
 template<typename DocumentPredicate>
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentPredicate document_predicate,
+                                                size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
 }
 
 template<typename Policy, typename DocumentPredicate>
 vector<Document>
-SearchServer::FindTopDocuments(Policy policy, string_view raw_query, DocumentPredicate document_predicate) const {
-    Query_for_par query = ParseQueryForPar(raw_query);
+SearchServer::FindTopDocuments(Policy policy, string_view raw_query, DocumentPredicate document_predicate,
+                               size_t top_count) const {
+    return FindTopDocuments(policy, ResolveQuery(ParseSearchQuery(policy, raw_query)), document_predicate, top_count);
+}
 
-    auto last_plus = std::unique(policy, query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(last_plus, query.plus_words.end());
-    auto last_minus = std::unique(policy, query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(last_minus, query.minus_words.end());
+template<typename Policy>
+SearchServer::Query_for_par SearchServer::ParseSearchQuery(Policy policy, string_view raw_query) const {
+    if constexpr (std::is_same_v<std::decay_t<Policy>, AdaptivePolicy>) {
+        // Разбор дёшев, параллелить его незачем
+        return ParseSearchQuery(std::execution::seq, raw_query);
+    } else {
+        Query_for_par query = ParseQueryForPar(raw_query);
 
-    if (!CorrectUseDashes(raw_query) || !IsValidWord(raw_query)) {
-        throw std::invalid_argument("invalid_argument"s);
+        auto last_plus = std::unique(policy, query.plus_words.begin(), query.plus_words.end());
+        query.plus_words.erase(last_plus, query.plus_words.end());
+        auto last_minus = std::unique(policy, query.minus_words.begin(), query.minus_words.end());
+        query.minus_words.erase(last_minus, query.minus_words.end());
+
+        if (!CorrectUseDashes(raw_query) || !IsValidWord(raw_query)) {
+            throw std::invalid_argument("invalid_argument"s);
+        }
+        return query;
     }
+}
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template<typename Policy, typename DocumentPredicate>
+vector<Document>
+SearchServer::FindTopDocuments(Policy policy, const QueryTerms& query, DocumentPredicate document_predicate,
+                               size_t top_count, SearchLimits limits) const {
+    if constexpr (std::is_same_v<std::decay_t<Policy>, AdaptivePolicy>) {
+        limits.parallelism = ChooseAdaptiveParallelism(EstimateQueryWork(query));
+        if (limits.parallelism == 1) {
+            return FindTopDocuments(std::execution::seq, query, document_predicate, top_count, limits);
+        }
+        return FindTopDocuments(std::execution::par, query, document_predicate, top_count, limits);
+    } else {
+        if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>) {
+            if (retrieval_mode_ != RetrievalMode::EXHAUSTIVE) {
+                return FindTopDocumentsMaxScore(query, document_predicate, top_count, limits);
+            }
+        } else {
+            if (parallel_split_ == ParallelSplit::BY_DOCUMENT_RANGE) {
+                return FindTopDocumentsByDocumentRanges(policy, query, document_predicate, top_count, limits);
+            }
+        }
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-         [](const Document& lhs, const Document& rhs) {
-             if (abs(lhs.relevance - rhs.relevance) < RELEVANCE_ERROR_RATE) {
-                 return lhs.rating > rhs.rating;
-             } else {
-                 return lhs.relevance > rhs.relevance;
-             }
-         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+        const auto matched_documents = FindAllDocuments(policy, query, document_predicate, limits);
 
-    return matched_documents;
+        return SelectTopDocuments(policy, matched_documents, top_count, executor_.get());
+    }
 }
 
 template<typename Policy>
-vector<Document> SearchServer::FindTopDocuments(Policy policy, string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query,
-                            [status](int document_id, DocumentStatus document_status, int rating) {
-                                return document_status == status;
-                            });
+vector<Document> SearchServer::FindTopDocuments(Policy policy, string_view raw_query, DocumentStatus status,
+                                                size_t top_count) const {
+    const auto document_predicate = [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    };
+    const QueryTerms query = ResolveQuery(ParseSearchQuery(policy, raw_query));
+    if (!query_cache_) {
+        return FindTopDocuments(policy, query, document_predicate, top_count);
+    }
+
+    QueryCache::Key key = MakeQueryCacheKey(query, status, top_count);
+    if (auto documents = query_cache_->Find(key, GetCorpusEpoch())) {
+        return std::move(*documents);
+    }
+    auto documents = FindTopDocuments(policy, query, document_predicate, top_count);
+    query_cache_->Insert(std::move(key), GetCorpusEpoch(), documents);
+    return documents;
 }
 
 template<typename Policy>
@@ -179,70 +773,929 @@ vector<Document> SearchServer::FindTopDocuments(Policy policy, string_view raw_q
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template<typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate,
+                                                size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, query, document_predicate, top_count);
+}
+
+template<typename Policy, typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(Policy policy, const PreparedQuery& query,
+                                                DocumentPredicate document_predicate, size_t top_count) const {
+    // Запрос, подготовленный другим сервером или до изменения индекса, находит термы заново
+    if (query.server_ == this && query.epoch_ == GetCorpusEpoch()) {
+        return FindTopDocuments(policy, query.terms_, document_predicate, top_count);
+    }
+    return FindTopDocuments(policy, ResolveQuery(query.query_), document_predicate, top_count);
+}
+
+template<typename Policy>
+vector<Document> SearchServer::FindTopDocuments(Policy policy, const PreparedQuery& query, DocumentStatus status,
+                                                size_t top_count) const {
+    const auto document_predicate = [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    };
+    QueryTerms resolved_terms;
+    const bool is_resolved = query.server_ == this && query.epoch_ == GetCorpusEpoch();
+    if (!is_resolved) {
+        resolved_terms = ResolveQuery(query.query_);
+    }
+    const QueryTerms& terms = is_resolved ? query.terms_ : resolved_terms;
+    if (!query_cache_) {
+        return FindTopDocuments(policy, terms, document_predicate, top_count);
+    }
+
+    QueryCache::Key key = MakeQueryCacheKey(terms, status, top_count);
+    if (auto documents = query_cache_->Find(key, GetCorpusEpoch())) {
+        return std::move(*documents);
+    }
+    auto documents = FindTopDocuments(policy, terms, document_predicate, top_count);
+    query_cache_->Insert(std::move(key), GetCorpusEpoch(), documents);
+    return documents;
+}
+
+template<typename Policy>
+vector<Document> SearchServer::FindTopDocuments(Policy policy, const PreparedQuery& query) const {
+    return FindTopDocuments(policy, query, DocumentStatus::ACTUAL);
+}
+
+template<typename Policy, typename DocumentPredicate>
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(Policy policy, span<const string> raw_queries,
+                                                             DocumentPredicate document_predicate,
+                                                             size_t top_count) const {
+    vector<QueryTerms> queries;
+    queries.reserve(raw_queries.size());
+    for (const string& raw_query : raw_queries) {
+        queries.push_back(ResolveQuery(ParseSearchQuery(std::execution::seq, raw_query)));
+    }
+    if constexpr (std::is_same_v<std::decay_t<Policy>, AdaptivePolicy>) {
+        size_t work = 0;
+        for (const QueryTerms& query : queries) {
+            work += EstimateQueryWork(query);
+        }
+        if (ChooseAdaptiveParallelism(work) == 1) {
+            return FindTopDocumentsBatch(std::execution::seq, queries, document_predicate, top_count);
+        }
+        return FindTopDocumentsBatch(std::execution::par, queries, document_predicate, top_count);
+    } else {
+        return FindTopDocumentsBatch(policy, queries, document_predicate, top_count);
+    }
+}
+
+template<typename Policy>
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(Policy policy, span<const string> raw_queries,
+                                                             DocumentStatus status, size_t top_count) const {
+    return FindTopDocumentsBatch(policy, raw_queries, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, top_count);
+}
+
+template<typename DocumentPredicate>
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(span<const string> raw_queries,
+                                                             DocumentPredicate document_predicate,
+                                                             size_t top_count) const {
+    return FindTopDocumentsBatch(std::execution::par, raw_queries, document_predicate, top_count);
+}
+
+template<typename Policy, typename DocumentPredicate>
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(Policy policy, const vector<QueryTerms>& queries,
+                                                             DocumentPredicate& document_predicate,
+                                                             size_t top_count) const {
+    const size_t document_count = documents_.size();
+    const size_t batch_size = clamp<size_t>(BATCH_ACCUMULATOR_BYTES / ((sizeof(double) + 1) * document_count + 1), 1,
+                                            MAX_BATCH_QUERY_COUNT);
+    const size_t batch_count = (queries.size() + batch_size - 1) / batch_size;
+    vector<vector<Document>> results(queries.size());
+    ParallelFor(executor_.get(), policy, batch_count, [&](size_t batch) {
+        const size_t first = batch * batch_size;
+        const size_t last = min(first + batch_size, queries.size());
+
+        vector<ScoreAccumulator::Ptr> accumulators;
+        accumulators.reserve(last - first);
+        for (size_t query = first; query < last; ++query) {
+            accumulators.push_back(ScoreAccumulator::Acquire(document_count));
+        }
+
+        // Термы всех запросов группы по возрастанию id, с номером запроса в группе: запросы с общим термом идут
+        // подряд, где бы он ни стоял в запросе, и его список обходится один раз для всех.
+        // Повторное слово запроса даёт две записи, и его вклад, как и в FindTopDocuments, учитывается дважды
+        struct TermQuery {
+            uint32_t term_id;
+            uint32_t query;
+            double inverse_document_freq;
+        };
+        vector<TermQuery> term_queries;
+        const auto for_each_term = [&term_queries](auto function) {
+            sort(term_queries.begin(), term_queries.end(), [](const TermQuery& lhs, const TermQuery& rhs) {
+                return pair(lhs.term_id, lhs.query) < pair(rhs.term_id, rhs.query);
+            });
+            for (auto begin = term_queries.begin(); begin != term_queries.end();) {
+                const uint32_t term_id = begin->term_id;
+                const auto end = find_if(begin, term_queries.end(), [term_id](const TermQuery& term_query) {
+                    return term_query.term_id != term_id;
+                });
+                function(term_id, begin, end);
+                begin = end;
+            }
+        };
+        const auto collect = [&](const vector<QueryTerm> QueryTerms::* terms) {
+            term_queries.clear();
+            for (size_t query = first; query < last; ++query) {
+                for (const QueryTerm& term : queries[query].*terms) {
+                    term_queries.push_back({term.term_id, static_cast<uint32_t>(query - first),
+                                            term.inverse_document_freq});
+                }
+            }
+        };
+
+        const auto add = [&](ScoreAccumulator& accumulator, uint32_t document_index, double score) {
+            if (accumulator.GetState(document_index) == ScoreAccumulator::State::EMPTY) {
+                const DocumentData& document_data = documents_[document_index];
+                accumulator.Touch(document_index, !removed_documents_[document_index]
+                                                  && document_predicate(document_data.id, document_data.status,
+                                                                        document_data.rating));
+            }
+            accumulator.Add(document_index, score);
+        };
+        collect(&QueryTerms::plus_terms);
+        for_each_term([&](uint32_t term_id, auto begin, auto end) {
+            const double inverse_document_freq = begin->inverse_document_freq;
+            // Часто терм есть только в одном запросе группы
+            if (end - begin == 1) {
+                ScoreAccumulator& accumulator = *accumulators[begin->query];
+                ForEachPosting(term_id, 0, static_cast<uint32_t>(document_count),
+                               [&](uint32_t document_index, double term_freq) {
+                                   add(accumulator, document_index, term_freq * inverse_document_freq);
+                               });
+                return;
+            }
+            ForEachPosting(term_id, 0, static_cast<uint32_t>(document_count),
+                           [&](uint32_t document_index, double term_freq) {
+                               const double score = term_freq * inverse_document_freq;
+                               for (auto it = begin; it != end; ++it) {
+                                   add(*accumulators[it->query], document_index, score);
+                               }
+                           });
+        });
+        collect(&QueryTerms::minus_terms);
+        for_each_term([&](uint32_t term_id, auto begin, auto end) {
+            ForEachPosting(term_id, 0, static_cast<uint32_t>(document_count), [&](uint32_t document_index, double) {
+                for (auto it = begin; it != end; ++it) {
+                    accumulators[it->query]->Reject(document_index);
+                }
+            });
+        });
+
+        for (size_t query = first; query < last; ++query) {
+            const ScoreAccumulator& accumulator = *accumulators[query - first];
+            TopDocuments top(top_count);
+            for (const uint32_t document_index : accumulator.GetTouched()) {
+                if (accumulator.GetState(document_index) == ScoreAccumulator::State::SCORED) {
+                    const DocumentData& document_data = documents_[document_index];
+                    top.Add({document_data.id, accumulator.GetScore(document_index), document_data.rating});
+                }
+            }
+            results[query] = std::move(top).Build();
+        }
+    });
+    return results;
+}
+
+template<typename DocumentPredicate>
+future<SearchResult> SearchServer::FindTopDocumentsAsync(string raw_query, chrono::steady_clock::time_point deadline,
+                                                         DocumentPredicate document_predicate, size_t top_count,
+                                                         stop_token stop_token) const {
+    auto search = [this, raw_query = std::move(raw_query), deadline, document_predicate, top_count,
+                   stop_token = std::move(stop_token)]() {
+        const QueryDeadline query_deadline(deadline, stop_token);
+        auto documents = FindTopDocuments(adaptive_execution,
+                                          ResolveQuery(ParseSearchQuery(adaptive_execution, raw_query)),
+                                          document_predicate, top_count, SearchLimits{0, &query_deadline});
+        return SearchResult{std::move(documents), !query_deadline.WasInterrupted()};
+    };
+    if (executor_) {
+        // std::function копирует задачу, поэтому обещание лежит в shared_ptr
+        auto result = make_shared<promise<SearchResult>>();
+        auto future = result->get_future();
+        if (executor_->TrySubmit([search, result]() {
+            try {
+                result->set_value(search());
+            } catch (...) {
+                result->set_exception(current_exception());
+            }
+        })) {
+            return future;
+        }
+        // Очередь executor заполнена: Submit выполнил бы запрос прямо здесь, а вызывающий не должен ждать
+    }
+    // Future из std::async дожидается запроса в деструкторе, так что брошенный запрос не переживёт её
+    return async(launch::async, std::move(search));
+}
+
 template<typename Policy, typename DocumentPredicate>
 vector<Document>
-SearchServer::FindAllDocuments(Policy policy, const Query_for_par& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance_concurrent(1000);
+SearchServer::FindAllDocuments(Policy policy, const QueryTerms& query, DocumentPredicate document_predicate,
+                               const SearchLimits& limits) const {
+    const size_t worker_count = std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>
+                                ? 1 : limits.parallelism == 0 ? GetParallelism() : limits.parallelism;
+    // Каждая группа термов копит очки в собственном массиве, поэтому блокировки не нужны.
+    // Массивы берутся из пула вызывающего потока и туда же возвращаются
+    auto term_groups = GroupTermsForWorkers(query.plus_terms, worker_count);
+    if (term_groups.empty()) {
+        return {};
+    }
+    vector<ScoreAccumulator::Ptr> accumulators;
+    accumulators.reserve(term_groups.size());
+    for (size_t i = 0; i < term_groups.size(); ++i) {
+        accumulators.push_back(ScoreAccumulator::Acquire(documents_.size()));
+    }
+
+    const auto accumulate_group = [this, &term_groups, &accumulators, &document_predicate, &limits](size_t group) {
+        for (const QueryTerm& term : term_groups[group]) {
+            if (limits.Expired()) {
+                break;
+            }
+            AccumulateTermScores(term, 0, static_cast<uint32_t>(documents_.size()), document_predicate,
+                                 *accumulators[group]);
+        }
+    };
+    if (term_groups.size() == 1) {
+        accumulate_group(0);
+    } else {
+        ParallelFor(executor_.get(), policy, term_groups.size(), accumulate_group);
+        for (size_t i = 1; i < accumulators.size(); ++i) {
+            accumulators[0]->Merge(*accumulators[i]);
+        }
+    }
+    ScoreAccumulator& document_to_relevance = *accumulators[0];
+
+    for (const QueryTerm& term : query.minus_terms) {
+        ForEachPosting(term.term_id, 0, static_cast<uint32_t>(documents_.size()),
+                       [&document_to_relevance](uint32_t document_index, double) {
+                           document_to_relevance.Reject(document_index);
+                       });
+    }
+
+    vector<Document> matched_documents;
+    matched_documents.reserve(document_to_relevance.GetTouched().size());
+    for (const uint32_t document_index : document_to_relevance.GetTouched()) {
+        if (document_to_relevance.GetState(document_index) == ScoreAccumulator::State::SCORED) {
+            const auto& document_data = documents_[document_index];
+            matched_documents.emplace_back(document_data.id, document_to_relevance.GetScore(document_index),
+                                           document_data.rating);
+        }
+    }
+    return matched_documents;
+}
+
+template<typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocumentsMaxScore(const QueryTerms& query, DocumentPredicate document_predicate,
+                                                        size_t top_count, const SearchLimits& limits) const {
+    TopDocuments top(top_count);
+    // Выдача общая для всех сегментов, поэтому порог, набранный в одном сегменте, отсекает документы следующих
+    for (const auto& segment : segments_) {
+        if (limits.Expired()
+            || !FindSegmentTopDocumentsMaxScore(*segment, query.plus_terms, query.minus_terms, document_predicate, top,
+                                                limits)) {
+            break;
+        }
+    }
+    return std::move(top).Build();
+}
+
+template<typename DocumentPredicate>
+bool SearchServer::FindSegmentTopDocumentsMaxScore(const IndexSegment& segment, const vector<QueryTerm>& plus_terms,
+                                                   const vector<QueryTerm>& minus_terms,
+                                                   DocumentPredicate& document_predicate, TopDocuments& top,
+                                                   const SearchLimits& limits) const {
+    vector<TermCursor> terms = MakeTermCursors(segment, plus_terms);
+    vector<TermCursor> minus_cursors = MakeTermCursors(segment, minus_terms);
+
+    // Термы по возрастанию верхней границы вклада. Первые non_essential из них вместе не наберут порога,
+    // поэтому кандидатов дают только остальные, а неосновные лишь досчитываются у кандидатов
+    vector<size_t> order(terms.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&terms](size_t lhs, size_t rhs) {
+        return terms[lhs].max_score < terms[rhs].max_score;
+    });
+    vector<double> max_score_prefix(terms.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        max_score_prefix[i] = (i == 0 ? 0 : max_score_prefix[i - 1]) + terms[order[i]].max_score;
+    }
+
+    const auto by_document = [&terms](size_t lhs, size_t rhs) {
+        return terms[lhs].cursor.DocumentIndex() > terms[rhs].cursor.DocumentIndex();
+    };
+    double threshold = top.GetThreshold();
+    size_t non_essential = 0;
+    while (non_essential < order.size() && max_score_prefix[non_essential] < threshold) {
+        ++non_essential;
+    }
+    vector<size_t> essential(order.begin() + non_essential, order.end());
+    make_heap(essential.begin(), essential.end(), by_document);
+
+    size_t posting_count = 0;
+    for (const TermCursor& term : terms) {
+        posting_count += term.posting_count;
+    }
+    const auto pruning_pays = [&]() {
+        size_t essential_posting_count = 0;
+        for (size_t i = non_essential; i < order.size(); ++i) {
+            essential_posting_count += terms[order[i]].posting_count;
+        }
+        return essential_posting_count * MIN_PRUNED_POSTINGS_RATIO <= posting_count;
+    };
+
+    // Те же суммы по максимумам блоков, в которые попадает текущий кандидат
+    const bool use_block_max = retrieval_mode_ == RetrievalMode::BLOCK_MAX_SCORE;
+    vector<double> block_score_prefix(use_block_max ? terms.size() : 0);
+
+    vector<double> contributions(terms.size());
+    vector<size_t> matched;
+    size_t candidate_count = 0;
+    while (!essential.empty()) {
+        const uint32_t document_index = terms[essential.front()].cursor.DocumentIndex();
+        if (document_index == PostingList::Cursor::END_DOCUMENT) {
+            break;
+        }
+        // Пока выдача не заполнена, порога нет, и о пользе отсечения судить рано. Документы до document_index
+        // уже учтены, а сам он ещё нет, так что диапазон начинается с него
+        if (candidate_count % PRUNING_CHECK_INTERVAL == 0 && top.IsFull() && !pruning_pays()) {
+            const uint32_t end_document_index = document_index + std::min(segment.EndDocumentIndex() - document_index,
+                                                                          TERM_AT_A_TIME_RANGE_SIZE);
+            if (!FindRangeTopDocuments(plus_terms, minus_terms, document_index, end_document_index,
+                                       document_predicate, top, limits)) {
+                return false;
+            }
+            for (TermCursor& term : terms) {
+                term.cursor.SkipTo(end_document_index);
+            }
+            threshold = top.GetThreshold();
+            while (non_essential < order.size() && max_score_prefix[non_essential] < threshold) {
+                ++non_essential;
+            }
+            essential.assign(order.begin() + non_essential, order.end());
+            make_heap(essential.begin(), essential.end(), by_document);
+            continue;
+        }
+        // Списки здесь обходятся одновременно, поэтому срок проверяется через каждые несколько кандидатов
+        if (++candidate_count % DEADLINE_CHECK_INTERVAL == 0 && limits.Expired()) {
+            return false;
+        }
+        matched.clear();
+        double score = 0;
+        while (terms[essential.front()].cursor.DocumentIndex() == document_index) {
+            pop_heap(essential.begin(), essential.end(), by_document);
+            TermCursor& term = terms[essential.back()];
+            contributions[essential.back()] = term.cursor.TermFreq() * term.inverse_document_freq;
+            score += contributions[essential.back()];
+            matched.push_back(essential.back());
+            term.cursor.Next();
+            push_heap(essential.begin(), essential.end(), by_document);
+        }
 
-    for_each(policy, query.plus_words.begin(), query.plus_words.end(), [this, &document_predicate, &document_to_relevance_concurrent, &query] (string_view word) {
-        string word_str = string(word);
-        if (word_to_document_freqs_.count(word_str) == 0) {
-            return ;
+        // Границы по блокам точнее, но их подсчёт стоит сдвига курсоров, поэтому они нужны только кандидатам,
+        // которых не отсекла общая граница
+        const bool passes_max_score = non_essential == 0 || score + max_score_prefix[non_essential - 1] >= threshold;
+        if (use_block_max && passes_max_score) {
+            for (size_t i = 0; i < non_essential; ++i) {
+                TermCursor& term = terms[order[i]];
+                term.cursor.ShallowSkipTo(document_index);
+                block_score_prefix[i] = (i == 0 ? 0 : block_score_prefix[i - 1])
+                                        + term.cursor.BlockMaxTermFreq() * term.inverse_document_freq;
+            }
+        }
+        if (!passes_max_score) {
+            continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word_str);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word_str)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-               // document_to_relevance_concurrent.BuildOrdinaryMap()[document_id] += term_freq * inverse_document_freq;
-                document_to_relevance_concurrent[document_id].ref_to_value += term_freq * inverse_document_freq;
+        const vector<double>& score_prefix = use_block_max ? block_score_prefix : max_score_prefix;
+
+        bool pruned = false;
+        for (size_t i = non_essential; i-- > 0;) {
+            if (score + score_prefix[i] < threshold) {
+                pruned = true;
+                break;
+            }
+            TermCursor& term = terms[order[i]];
+            term.cursor.SkipTo(document_index);
+            if (term.cursor.DocumentIndex() == document_index) {
+                contributions[order[i]] = term.cursor.TermFreq() * term.inverse_document_freq;
+                score += contributions[order[i]];
+                matched.push_back(order[i]);
             }
         }
+        if (pruned || score < threshold) {
+            continue;
+        }
+
+        const bool has_minus_word = any_of(minus_cursors.begin(), minus_cursors.end(),
+                                           [document_index](TermCursor& term) {
+                                               term.cursor.SkipTo(document_index);
+                                               return term.cursor.DocumentIndex() == document_index;
+                                           });
+        const auto& document_data = documents_[document_index];
+        if (has_minus_word || removed_documents_[document_index]
+            || !document_predicate(document_data.id, document_data.status, document_data.rating)) {
+            continue;
+        }
+        // Сумма в порядке слов запроса, как в FindAllDocuments, чтобы релевантность совпадала до бита
+        sort(matched.begin(), matched.end());
+        double relevance = 0;
+        for (const size_t term : matched) {
+            relevance += contributions[term];
+        }
+        top.Add({document_data.id, relevance, document_data.rating});
+
+        threshold = top.GetThreshold();
+        const size_t old_non_essential = non_essential;
+        while (non_essential < order.size() && max_score_prefix[non_essential] < threshold) {
+            ++non_essential;
+        }
+        if (non_essential != old_non_essential) {
+            essential.assign(order.begin() + non_essential, order.end());
+            make_heap(essential.begin(), essential.end(), by_document);
+        }
+    }
+    return true;
+}
+
+template<typename Policy, typename DocumentPredicate>
+vector<Document>
+SearchServer::FindTopDocumentsByDocumentRanges(Policy policy, const QueryTerms& query,
+                                               DocumentPredicate document_predicate, size_t top_count,
+                                               const SearchLimits& limits) const {
+    const vector<QueryTerm>& plus_terms = query.plus_terms;
+    if (plus_terms.empty()) {
+        return {};
+    }
+    const vector<QueryTerm>& minus_terms = query.minus_terms;
+    const size_t document_count = documents_.size();
+    // Диапазонов с запасом больше, чем потоков: плотность списков по диапазонам неравна, и свободные потоки
+    // забирают оставшиеся диапазоны. Заданный parallelism уже рассчитан на объём работы и соблюдается точно
+    const size_t range_count = std::clamp<size_t>(document_count / MIN_DOCUMENT_RANGE_SIZE, 1,
+                                                  limits.parallelism == 0 ? 4 * GetParallelism()
+                                                                          : limits.parallelism);
+
+    // Диапазоны не пересекаются, поэтому каждый поток пишет только в свои массив очков и выдачу
+    vector<TopDocuments> tops(range_count, TopDocuments(top_count));
+    const auto find_in_range = [&](size_t range) {
+        FindRangeTopDocuments(plus_terms, minus_terms, static_cast<uint32_t>(document_count * range / range_count),
+                              static_cast<uint32_t>(document_count * (range + 1) / range_count), document_predicate,
+                              tops[range], limits);
+    };
+    if (range_count == 1) {
+        find_in_range(0);
+    } else {
+        ParallelFor(executor_.get(), policy, range_count, find_in_range);
+    }
+    for (size_t i = 1; i < range_count; ++i) {
+        tops[0].Merge(tops[i]);
+    }
+    return std::move(tops[0]).Build();
+}
+
+template<typename DocumentPredicate>
+bool SearchServer::FindRangeTopDocuments(const vector<QueryTerm>& plus_terms, const vector<QueryTerm>& minus_terms,
+                                         uint32_t first_document_index, uint32_t end_document_index,
+                                         DocumentPredicate& document_predicate, TopDocuments& top,
+                                         const SearchLimits& limits) const {
+    // Массив очков покрывает только диапазон, так что диапазоны не умножают ни память, ни её очистку
+    const ScoreAccumulator::Ptr accumulator = ScoreAccumulator::Acquire(first_document_index, end_document_index);
+    bool complete = true;
+    for (const QueryTerm& term : plus_terms) {
+        if (limits.Expired()) {
+            complete = false;
+            break;
+        }
+        AccumulateTermScores(term, first_document_index, end_document_index, document_predicate, *accumulator);
+    }
+    for (const QueryTerm& term : minus_terms) {
+        ForEachPosting(term.term_id, first_document_index, end_document_index,
+                       [&accumulator](uint32_t document_index, double) {
+                           accumulator->Reject(document_index);
+                       });
+    }
+    for (const uint32_t document_index : accumulator->GetTouched()) {
+        if (accumulator->GetState(document_index) == ScoreAccumulator::State::SCORED) {
+            const auto& document_data = documents_[document_index];
+            top.Add({document_data.id, accumulator->GetScore(document_index), document_data.rating});
+        }
+    }
+    return complete;
+}
+
+template<typename Function>
+void SearchServer::ForEachPosting(uint32_t term_id, uint32_t first_document_index, uint32_t end_document_index,
+                                  Function function) const {
+    for (const auto& segment : segments_) {
+        if (segment->EndDocumentIndex() <= first_document_index
+            || segment->FirstDocumentIndex() >= end_document_index) {
+            continue;
+        }
+        const PostingList* postings = segment->FindPostings(term_id);
+        if (postings == nullptr) {
+            continue;
+        }
+        auto block = postings->Blocks();
+        block.SkipTo(first_document_index);
+        for (; !block.AtEnd() && block.FirstDocumentIndex() < end_document_index; block.Next()) {
+            const uint32_t* document_indexes = block.DocumentIndexes();
+            const double* term_freqs = block.TermFreqs();
+            // Обрезать по границам диапазона нужно только крайние блоки
+            const size_t first = block.FirstDocumentIndex() >= first_document_index
+                                 ? 0 : lower_bound(document_indexes, document_indexes + block.size(),
+                                                   first_document_index) - document_indexes;
+            const size_t last = block.LastDocumentIndex() < end_document_index
+                                ? block.size() : lower_bound(document_indexes, document_indexes + block.size(),
+                                                             end_document_index) - document_indexes;
+            for (size_t i = first; i < last; ++i) {
+                function(document_indexes[i], term_freqs[i]);
+            }
+        }
+    }
+}
+
+template<typename DocumentPredicate>
+void SearchServer::AccumulateTermScores(const QueryTerm& term, uint32_t first_document_index,
+                                        uint32_t end_document_index, DocumentPredicate& document_predicate,
+                                        ScoreAccumulator& accumulator) const {
+    ForEachPosting(term.term_id, first_document_index, end_document_index,
+                   [&](uint32_t document_index, double term_freq) {
+                       // Предикат вычисляется один раз на документ, а не на каждое его слово
+                       if (accumulator.GetState(document_index) == ScoreAccumulator::State::EMPTY) {
+                           const auto& document_data = documents_[document_index];
+                           accumulator.Touch(document_index,
+                                             !removed_documents_[document_index]
+                                             && document_predicate(document_data.id, document_data.status,
+                                                                   document_data.rating));
+                       }
+                       accumulator.Add(document_index, term_freq * term.inverse_document_freq);
+                   });
+}
+
+template<typename Policy>
+tuple<vector<string_view>, DocumentStatus>
+SearchServer::MatchParsedQuery(Policy policy, const Query_for_par& query, int document_id) const {
+    const uint32_t document_index = document_indexes_.at(document_id);
+    const auto is_word_in_document = [this, document_index](string_view word) {
+        const TermData* term = FindTerm(word);
+        return term != nullptr && IsWordInDocument(document_index, *term);
+    };
+    if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), is_word_in_document)) {
+        return {vector<string_view>{}, documents_[document_index].status};
+    }
+
+    vector<string_view> matched_words(query.plus_words.size());
+    transform(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(),
+              [&is_word_in_document](string_view word) {
+                  return is_word_in_document(word) ? word : string_view{};
+              });
+    sort(policy, matched_words.begin(), matched_words.end());
+    matched_words.erase(unique(policy, matched_words.begin(), matched_words.end()), matched_words.end());
+
+    // Несовпавшие слова заменены пустыми, после сортировки пустое слово одно и стоит первым
+    if (!matched_words.empty() && matched_words.front().empty()) {
+        matched_words.erase(matched_words.begin());
+    }
+    return {matched_words, documents_[document_index].status};
+}
+
+template<typename Policy>
+vector<tuple<vector<string_view>, DocumentStatus>>
+SearchServer::MatchDocuments(Policy policy, string_view raw_query, span<const int> document_ids) const {
+    if (!CorrectUseDashes(raw_query) || !IsValidWord(raw_query)) {
+        throw invalid_argument("invalid_argument"s);
+    }
+    // Слова по возрастанию и без повторов, как в выдаче MatchDocument
+    const auto query = ParseQuery(raw_query);
+    vector<pair<string_view, const TermData*>> plus_terms;
+    for (const string_view word : query.plus_words) {
+        if (const TermData* term = FindTerm(word)) {
+            plus_terms.emplace_back(word, term);
+        }
+    }
+    vector<const TermData*> minus_terms;
+    for (const string_view word : query.minus_words) {
+        if (const TermData* term = FindTerm(word)) {
+            minus_terms.push_back(term);
+        }
+    }
+    vector<uint32_t> document_indexes;
+    document_indexes.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        document_indexes.push_back(document_indexes_.at(document_id));
+    }
+
+    vector<tuple<vector<string_view>, DocumentStatus>> result(document_ids.size());
+    const auto match = [&](size_t number) {
+        const uint32_t document_index = document_indexes[number];
+        auto& [matched_words, status] = result[number];
+        status = documents_[document_index].status;
+        if (any_of(minus_terms.begin(), minus_terms.end(), [this, document_index](const TermData* term) {
+            return IsWordInDocument(document_index, *term);
+        })) {
+            return;
+        }
+        for (const auto& [word, term] : plus_terms) {
+            if (IsWordInDocument(document_index, *term)) {
+                matched_words.push_back(word);
+            }
+        }
+    };
+    if constexpr (std::is_same_v<std::decay_t<Policy>, AdaptivePolicy>) {
+        const size_t work = document_ids.size() * (plus_terms.size() + minus_terms.size());
+        if (ChooseAdaptiveParallelism(work) == 1) {
+            ParallelFor(executor_.get(), std::execution::seq, document_ids.size(), match);
+        } else {
+            ParallelFor(executor_.get(), std::execution::par, document_ids.size(), match);
+        }
+    } else {
+        ParallelFor(executor_.get(), policy, document_ids.size(), match);
+    }
+    return result;
+}
+
+template<typename Policy>
+void SearchServer::AddDocuments(Policy policy, span<const NewDocument> documents) {
+    CheckNewDocumentIds(documents);
+    if (duplicate_handling_ == DuplicateHandling::ALLOW) {
+        AddNewDocuments(policy, documents);
+        return;
+    }
+    const vector<size_t> accepted = CheckDuplicates(documents);
+    const auto first_document_index = static_cast<uint32_t>(documents_.size());
+    if (accepted.size() == documents.size()) {
+        AddNewDocuments(policy, documents);
+    } else {
+        vector<NewDocument> accepted_documents;
+        accepted_documents.reserve(accepted.size());
+        for (const size_t number : accepted) {
+            accepted_documents.push_back(documents[number]);
+        }
+        AddNewDocuments(policy, span<const NewDocument>(accepted_documents));
+    }
+    for (auto document_index = first_document_index; document_index < documents_.size(); ++document_index) {
+        InsertSignature(document_index);
+    }
+}
+
+template<typename Policy>
+void SearchServer::AddNewDocuments(Policy policy, span<const NewDocument> documents) {
+    if (documents.empty()) {
+        return;
+    }
+    InstallMerge(false);
+    const size_t worker_count = std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>
+                                ? 1 : GetParallelism();
+    const auto first_document_index = static_cast<uint32_t>(documents_.size());
+
+    // Разбор текстов — основная работа, он идёт по непрерывным кускам пакета без общих данных
+    vector<PartialIndex> partial_indexes(std::min(worker_count, documents.size()));
+    const size_t part_count = partial_indexes.size();
+    ParallelFor(executor_.get(), policy, part_count, [&](size_t part) {
+        const size_t first = documents.size() * part / part_count;
+        const size_t last = documents.size() * (part + 1) / part_count;
+        partial_indexes[part] = BuildPartialIndex(documents.subspan(first, last - first),
+                                                  first_document_index + static_cast<uint32_t>(first));
     });
+    for (const PartialIndex& partial_index : partial_indexes) {
+        if (partial_index.error) {
+            rethrow_exception(partial_index.error);
+        }
+    }
 
-    for_each(policy, query.minus_words.begin(), query.minus_words.end(), [this, &document_to_relevance_concurrent](string_view word) {
-        string word_str = string(word);
-        if (word_to_document_freqs_.count(word_str) == 0) {
-            return ;
+    // Словарь пополняется последовательно, но только различными словами каждой части
+    vector<vector<const PartialPostings*>> term_postings(terms_.size());
+    vector<uint32_t> touched_terms;
+    for (PartialIndex& partial_index : partial_indexes) {
+        partial_index.term_ids.reserve(partial_index.words.size());
+        for (size_t word = 0; word < partial_index.words.size(); ++word) {
+            const uint32_t term_id = InternTerm(partial_index.words[word]);
+            partial_index.term_ids.push_back(term_id);
+            if (term_id >= term_postings.size()) {
+                term_postings.resize(term_id + 1);
+            }
+            if (term_postings[term_id].empty()) {
+                touched_terms.push_back(term_id);
+            }
+            term_postings[term_id].push_back(&partial_index.postings[word]);
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word_str)) {
-            document_to_relevance_concurrent.erase(document_id);
+    }
+
+    // Списки сегмента создаются заранее и по одному: создание нового может сдвинуть остальные
+    IndexSegment& segment = *segments_.back();
+    for (const uint32_t term_id : touched_terms) {
+        segment.GetPostings(term_id);
+    }
+    vector<PostingList*> segment_postings;
+    segment_postings.reserve(touched_terms.size());
+    for (const uint32_t term_id : touched_terms) {
+        segment_postings.push_back(&segment.GetPostings(term_id));
+    }
+
+    // Части идут по возрастанию индексов документов, поэтому каждый список только дописывается в конец
+    ParallelFor(executor_.get(), policy, touched_terms.size(), [&](size_t number) {
+        const uint32_t term_id = touched_terms[number];
+        PostingList& postings = *segment_postings[number];
+        for (const PartialPostings* partial_postings : term_postings[term_id]) {
+            for (const auto& [document_index, term_freq] : *partial_postings) {
+                postings.Add(document_index, term_freq);
+            }
+            terms_[term_id].document_count += partial_postings->size();
         }
     });
 
-    map<int, double> document_to_relevance = document_to_relevance_concurrent.BuildOrdinaryMap();
+    vector<map<string_view, double>> interned_word_freqs(documents.size());
+    ParallelFor(executor_.get(), policy, part_count, [&](size_t part) {
+        const PartialIndex& partial_index = partial_indexes[part];
+        const size_t first = documents.size() * part / part_count;
+        for (size_t number = 0; number < partial_index.word_freqs.size(); ++number) {
+            auto& word_freqs = interned_word_freqs[first + number];
+            for (const auto& [word, term_freq] : partial_index.word_freqs[number]) {
+                word_freqs.emplace_hint(word_freqs.end(), terms_[partial_index.term_ids[word]].word, term_freq);
+            }
+        }
+    });
 
-    vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance.size() + 1);
+    for (const PartialIndex& partial_index : partial_indexes) {
+        for (const auto& word_freqs : partial_index.word_freqs) {
+            const size_t first_term = document_term_ids_.size();
+            for (const auto& [word, term_freq] : word_freqs) {
+                document_term_ids_.push_back(partial_index.term_ids[word]);
+            }
+            std::sort(document_term_ids_.begin() + static_cast<ptrdiff_t>(first_term), document_term_ids_.end());
+            document_term_offsets_.push_back(document_term_ids_.size());
+        }
+    }
 
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.emplace_back(document_id, relevance, documents_.at(document_id).rating);
+    for (size_t number = 0; number < documents.size(); ++number) {
+        const NewDocument& document = documents[number];
+        documents_to_words_freqs_.emplace(document.id, std::move(interned_word_freqs[number]));
+        documents_.push_back(DocumentData{document.id, ComputeAverageRating(document.ratings), document.status});
+        document_indexes_.emplace(document.id, first_document_index + static_cast<uint32_t>(number));
+        document_ids_.insert(document.id);
     }
-    return matched_documents;
+    segment.AddDocuments(documents.size());
+    removed_documents_.resize(documents_.size(), false);
+    ++corpus_epoch_;
+    SealFullSegment();
+}
+
+template<typename Function>
+void SearchServer::ForEachDocumentTerm(uint32_t document_index, Function function) const {
+    if (snapshot_ != nullptr && document_index < snapshot_->document_count) {
+        for (const SnapshotWordFreq& word_freq : GetSnapshotWordFreqs(documents_[document_index].id)) {
+            function(word_freq.term_id);
+        }
+        return;
+    }
+    for (uint64_t i = document_term_offsets_[document_index]; i < document_term_offsets_[document_index + 1]; ++i) {
+        function(document_term_ids_[i]);
+    }
+}
+
+template<typename Policy>
+vector<int> SearchServer::FindDuplicateDocuments(Policy policy) const {
+    // Документы по возрастанию id: из одинаковых остаётся документ с меньшим id
+    vector<uint32_t> document_indexes;
+    document_indexes.reserve(document_indexes_.size());
+    for (const auto& [document_id, document_index] : document_indexes_) {
+        document_indexes.push_back(document_index);
+    }
+    vector<pair<DocumentSignature, size_t>> signatures(document_indexes.size());
+    ParallelFor(executor_.get(), policy, document_indexes.size(), [&](size_t number) {
+        signatures[number] = {ComputeDocumentSignature(document_indexes[number]), number};
+    });
+    std::sort(policy, signatures.begin(), signatures.end());
+
+    // В группе с одной сигнатурой документы идут по возрастанию id и сравниваются с уже оставленными
+    vector<int> duplicates;
+    vector<uint32_t> originals;
+    for (size_t first = 0; first < signatures.size();) {
+        size_t last = first + 1;
+        while (last < signatures.size() && signatures[last].first == signatures[first].first) {
+            ++last;
+        }
+        originals.clear();
+        for (size_t i = first; i < last; ++i) {
+            const uint32_t document_index = document_indexes[signatures[i].second];
+            if (any_of(originals.begin(), originals.end(), [this, document_index](uint32_t original) {
+                return HaveSameTerms(original, document_index);
+            })) {
+                duplicates.push_back(documents_[document_index].id);
+            } else {
+                originals.push_back(document_index);
+            }
+        }
+        first = last;
+    }
+    std::sort(duplicates.begin(), duplicates.end());
+    return duplicates;
 }
 
+template<typename Policy>
+vector<vector<int>> SearchServer::FindNearDuplicateDocuments(Policy policy, double jaccard_threshold) const {
+    if (!(jaccard_threshold > 0 && jaccard_threshold <= 1)) {
+        throw invalid_argument("Jaccard threshold must be in (0, 1]"s);
+    }
+    vector<uint32_t> document_indexes;
+    document_indexes.reserve(document_indexes_.size());
+    for (const auto& [document_id, document_index] : document_indexes_) {
+        document_indexes.push_back(document_index);
+    }
+    const size_t document_count = document_indexes.size();
+    const size_t band_rows = ChooseBandRows(jaccard_threshold);
+    const size_t band_count = MIN_HASH_COUNT / band_rows;
+    // Хранятся только ключи полос документа number, с band_keys[number * band_count]
+    vector<uint32_t> band_keys(document_count * band_count);
+    ParallelFor(executor_.get(), policy, document_count, [&](size_t number) {
+        ComputeBandKeys(document_indexes[number], band_rows, span(band_keys).subspan(number * band_count, band_count));
+    });
+
+    // Группы — деревья по номерам документов, корень — меньший номер
+    vector<uint32_t> parents(document_count);
+    iota(parents.begin(), parents.end(), 0);
+    const auto find_root = [&parents](uint32_t number) {
+        while (parents[number] != number) {
+            parents[number] = parents[parents[number]];
+            number = parents[number];
+        }
+        return number;
+    };
+    // Полосы обрабатываются по одной, чтобы в памяти был один отсортированный массив ключей
+    vector<pair<uint32_t, uint32_t>> keys(document_count);
+    for (size_t band = 0; band < band_count; ++band) {
+        for (size_t number = 0; number < document_count; ++number) {
+            keys[number] = {band_keys[number * band_count + band], static_cast<uint32_t>(number)};
+        }
+        std::sort(policy, keys.begin(), keys.end());
+        // Документ с совпавшим ключом сравнивается только с предыдущим: цепочка связывает всю группу
+        // без проверки всех пар, поэтому шаблонные страницы с тысячами копий не делают работу квадратичной
+        for (size_t i = 1; i < document_count; ++i) {
+            if (keys[i].first != keys[i - 1].first) {
+                continue;
+            }
+            const uint32_t lhs_root = find_root(keys[i - 1].second);
+            const uint32_t rhs_root = find_root(keys[i].second);
+            if (lhs_root != rhs_root
+                && ComputeJaccard(document_indexes[keys[i - 1].second], document_indexes[keys[i].second])
+                   >= jaccard_threshold) {
+                parents[max(lhs_root, rhs_root)] = min(lhs_root, rhs_root);
+            }
+        }
+    }
+
+    vector<vector<int>> groups;
+    vector<uint32_t> group_numbers(document_count, UINT32_MAX);
+    for (uint32_t number = 0; number < document_count; ++number) {
+        const uint32_t root = find_root(number);
+        if (root == number) {
+            continue;
+        }
+        if (group_numbers[root] == UINT32_MAX) {
+            group_numbers[root] = static_cast<uint32_t>(groups.size());
+            groups.push_back({documents_[document_indexes[root]].id});
+        }
+        groups[group_numbers[root]].push_back(documents_[document_indexes[number]].id);
+    }
+    std::sort(groups.begin(), groups.end());
+    return groups;
+}
 
 template<typename P>
 void SearchServer::RemoveDocument(P policy, int document_id) {
-    std::vector<string_view> words_to_delete(GetWordFrequencies(document_id).size());
-
-    std::transform(policy, documents_to_words_freqs_.at(document_id).begin(),
-                   documents_to_words_freqs_.at(document_id).end(), words_to_delete.begin(),
-                   [](const pair<const string_view, double>& word) {
-                       //auto* word_ref = const_cast<string*>(&word.first);
-                       return word.first;
-                   });
+    InstallMerge(false);
+    const uint32_t document_index = document_indexes_.at(document_id);
+    std::vector<TermData*> terms_to_update;
 
-    std::for_each(policy, words_to_delete.begin(), words_to_delete.end(),
-                  [&document_id, this](string_view word) {
+    if (const auto it = documents_to_words_freqs_.find(document_id); it != documents_to_words_freqs_.end()) {
+        const auto& word_freqs = it->second;
+        terms_to_update.resize(word_freqs.size());
+        std::transform(policy, word_freqs.begin(), word_freqs.end(), terms_to_update.begin(),
+                       [this](const pair<const string_view, double>& word) {
+                           return &terms_[term_ids_.at(word.first)];
+                       });
+    } else {
+        for (const SnapshotWordFreq& word_freq : GetSnapshotWordFreqs(document_id)) {
+            terms_to_update.push_back(&terms_[word_freq.term_id]);
+        }
+        snapshot_->materialized_word_freqs.erase(document_id);
+    }
 
-                      word_to_document_freqs_.at(string(word)).erase(document_id);
+    // Вхождения остаются в сегменте до его слияния, поиск пропускает их по removed_documents_
+    std::for_each(policy, terms_to_update.begin(), terms_to_update.end(),
+                  [](TermData* term) {
+                      --term->document_count;
                   });
+    if (duplicate_handling_ != DuplicateHandling::ALLOW) {
+        EraseSignature(document_index);
+    }
+    removed_documents_[document_index] = true;
+    segments_[FindSegment(document_index)]->MarkRemoved(1);
 
-
-    //Удавление из списка документов и их слов
     documents_to_words_freqs_.erase(document_id);
-    //Удаление из списка документов
-    documents_.erase(document_id);
-    //Удаление из списка айди
+    document_indexes_.erase(document_id);
     document_ids_.erase(document_id);
-}
\ No newline at end of file
+    ++corpus_epoch_;
+    ScheduleMerge();
+}
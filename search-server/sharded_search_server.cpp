@@ -0,0 +1,106 @@
+#include "sharded_search_server.h"
+
+void ShardedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                                      const std::vector<int>& ratings) {
+    SearchServer& shard = shards_[GetShard(document_id)];
+    shard.AddDocument(document_id, document, status, ratings);
+    statistics_->AddDocument(shard.GetWordFrequencies(document_id));
+}
+
+void ShardedSearchServer::AddDocuments(std::span<const NewDocument> documents) {
+    std::vector<std::vector<NewDocument>> shard_documents(shards_.size());
+    for (const NewDocument& document : documents) {
+        shard_documents[GetShard(document.id)].push_back(document);
+    }
+
+    std::vector<std::exception_ptr> errors(shards_.size());
+    ParallelFor(shards_.front().GetExecutor(), std::execution::par, shards_.size(), [&](size_t shard) {
+        try {
+            shards_[shard].AddDocuments(std::execution::seq, shard_documents[shard]);
+        } catch (...) {
+            errors[shard] = std::current_exception();
+        }
+    });
+    const auto error = std::find_if(errors.begin(), errors.end(), [](const std::exception_ptr& error) {
+        return error != nullptr;
+    });
+    if (error != errors.end()) {
+        // Часть с ошибкой не изменилась, из остальных загруженное удаляется
+        for (size_t shard = 0; shard < shards_.size(); ++shard) {
+            if (errors[shard] == nullptr) {
+                for (const NewDocument& document : shard_documents[shard]) {
+                    shards_[shard].RemoveDocument(document.id);
+                }
+            }
+        }
+        std::rethrow_exception(*error);
+    }
+
+    for (const NewDocument& document : documents) {
+        statistics_->AddDocument(shards_[GetShard(document.id)].GetWordFrequencies(document.id));
+    }
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    SearchServer& shard = shards_[GetShard(document_id)];
+    // Слова документа остаются в словаре части, поэтому ключи копии переживают удаление
+    const std::map<std::string_view, double> word_freqs = shard.GetWordFrequencies(document_id);
+    shard.RemoveDocument(document_id);
+    statistics_->RemoveDocument(word_freqs);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                                            size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, top_count);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus>
+ShardedSearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
+    return shards_[GetShard(document_id)].MatchDocument(raw_query, document_id);
+}
+
+const std::map<std::string_view, double>& ShardedSearchServer::GetWordFrequencies(int document_id) const {
+    return shards_[GetShard(document_id)].GetWordFrequencies(document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    return static_cast<int>(statistics_->GetDocumentCount());
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+void ShardedSearchServer::SetRetrievalMode(RetrievalMode mode) {
+    for (SearchServer& shard : shards_) {
+        shard.SetRetrievalMode(mode);
+    }
+}
+
+void ShardedSearchServer::SetPostingsCompression(bool enabled) {
+    for (SearchServer& shard : shards_) {
+        shard.SetPostingsCompression(enabled);
+    }
+}
+
+void ShardedSearchServer::SetQueryCacheCapacity(size_t capacity) {
+    for (SearchServer& shard : shards_) {
+        shard.SetQueryCacheCapacity(capacity);
+    }
+}
+
+void ShardedSearchServer::SetExecutor(std::shared_ptr<WorkStealingExecutor> executor) {
+    for (SearchServer& shard : shards_) {
+        shard.SetExecutor(executor);
+    }
+}
+
+size_t ShardedSearchServer::GetShard(int document_id) const {
+    // Фибоначчиево хеширование: подряд идущие id расходятся по частям равномерно
+    const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9e3779b97f4a7c15ull;
+    return static_cast<size_t>(hash >> 32) % shards_.size();
+}
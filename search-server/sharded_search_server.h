@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <execution>
+#include <map>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "corpus_statistics.h"
+#include "document.h"
+#include "search_server.h"
+#include "top_documents.h"
+#include "work_stealing_executor.h"
+
+// Индекс, разбитый по хешу id документа на несколько SearchServer. Запрос выполняется во всех частях
+// параллельно, и их выдачи сливаются в общую в обычном порядке. IDF считается по общей статистике частей,
+// поэтому выдача та же, что у одного SearchServer с теми же документами
+class ShardedSearchServer {
+public:
+    template<typename StopWords>
+    ShardedSearchServer(const StopWords& stop_words, size_t shard_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                     const std::vector<int>& ratings);
+
+    // Документы раскладываются по частям и загружаются в них параллельно.
+    // При ошибке в любом документе исключение бросается, а индекс остаётся прежним
+    void AddDocuments(std::span<const NewDocument> documents);
+
+    void RemoveDocument(int document_id);
+
+    // policy задаёт выполнение запроса внутри части; части опрашиваются параллельно всегда,
+    // поэтому document_predicate может вызываться из нескольких потоков одновременно
+    template<typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(Policy policy, std::string_view raw_query,
+                                           DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template<typename Policy>
+    std::vector<Document> FindTopDocuments(Policy policy, std::string_view raw_query, DocumentStatus status,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template<typename Policy>
+    std::vector<Document> FindTopDocuments(Policy policy, std::string_view raw_query) const;
+
+    template<typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
+                                                                            int document_id) const;
+
+    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+    void SetRetrievalMode(RetrievalMode mode);
+
+    void SetPostingsCompression(bool enabled);
+
+    // Ёмкость кэша выдачи каждой части
+    void SetQueryCacheCapacity(size_t capacity);
+
+    // Один executor на все части: на нём идут и опрос частей, и параллельные части запросов в них
+    void SetExecutor(std::shared_ptr<WorkStealingExecutor> executor);
+
+private:
+    // Статистика лежит отдельно, чтобы указатели на неё в частях пережили перемещение сервера
+    std::unique_ptr<CorpusStatistics> statistics_;
+    std::vector<SearchServer> shards_;
+
+    size_t GetShard(int document_id) const;
+
+    // Выполняет search(const SearchServer&) во всех частях параллельно и сливает их выдачи
+    template<typename Search>
+    std::vector<Document> SearchShards(Search search, size_t top_count) const;
+};
+
+template<typename StopWords>
+ShardedSearchServer::ShardedSearchServer(const StopWords& stop_words, size_t shard_count)
+        : statistics_(std::make_unique<CorpusStatistics>()) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive");
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words).SetCorpusStatistics(statistics_.get());
+    }
+}
+
+template<typename Search>
+std::vector<Document> ShardedSearchServer::SearchShards(Search search, size_t top_count) const {
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    std::vector<std::exception_ptr> errors(shards_.size());
+    ParallelFor(shards_.front().GetExecutor(), std::execution::par, shards_.size(), [&](size_t shard) {
+        try {
+            shard_documents[shard] = search(shards_[shard]);
+        } catch (...) {
+            errors[shard] = std::current_exception();
+        }
+    });
+    // Запрос разбирается в каждой части одинаково, так что и ошибка у всех одна
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    TopDocuments top(top_count);
+    for (const std::vector<Document>& documents : shard_documents) {
+        for (const Document& document : documents) {
+            top.Add(document);
+        }
+    }
+    return std::move(top).Build();
+}
+
+template<typename Policy, typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(Policy policy, std::string_view raw_query,
+                                                            DocumentPredicate document_predicate,
+                                                            size_t top_count) const {
+    return SearchShards([&](const SearchServer& shard) {
+        return shard.FindTopDocuments(policy, raw_query, document_predicate, top_count);
+    }, top_count);
+}
+
+template<typename Policy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(Policy policy, std::string_view raw_query,
+                                                            DocumentStatus status, size_t top_count) const {
+    // Через перегрузку со статусом, чтобы работал кэш выдачи частей
+    return SearchShards([&](const SearchServer& shard) {
+        return shard.FindTopDocuments(policy, raw_query, status, top_count);
+    }, top_count);
+}
+
+template<typename Policy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(Policy policy, std::string_view raw_query) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template<typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+                                                            DocumentPredicate document_predicate,
+                                                            size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
+}
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // Размер всего файла и контрольная сумма всего, что идёт за заголовком
+    uint64_t size;
+    uint64_t checksum;
+};
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'S', 'N', 'A', 'P', 'S', 'H', 'T'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint32_t FOREIGN_BYTE_ORDER_MARK = 0x04030201;
+
+const uint64_t CHECKSUM_SEED = 0xcbf29ce484222325ull;
+
+size_t AlignedSize(size_t size) {
+    return (size + 7) & ~size_t{7};
+}
+
+// FNV-1a по 64-битным словам; хвост короче слова дополняется нулями, как и в файле
+uint64_t UpdateChecksum(uint64_t checksum, const char* data, size_t size) {
+    for (size_t offset = 0; offset < size; offset += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + offset, std::min(sizeof(uint64_t), size - offset));
+        checksum = (checksum ^ word) * 0x100000001b3ull;
+    }
+    return checksum;
+}
+
+} // namespace
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+        : path_(path), temporary_path_(path + ".tmp"s),
+          out_(temporary_path_, std::ios::binary | std::ios::trunc), checksum_(CHECKSUM_SEED) {
+    if (!out_) {
+        throw std::runtime_error("Cannot create snapshot "s + temporary_path_);
+    }
+    const SnapshotHeader placeholder{};
+    out_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+    size_ = sizeof(placeholder);
+}
+
+void SnapshotWriter::WriteStrings(const std::vector<std::string_view>& strings) {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    std::string chars;
+    for (const std::string_view string : strings) {
+        offsets.push_back(chars.size());
+        chars += string;
+    }
+    offsets.push_back(chars.size());
+    WriteArray<uint64_t>(offsets);
+    WriteArray<char>(chars);
+}
+
+void SnapshotWriter::Finish() {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.size = size_;
+    header.checksum = checksum_;
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("Cannot write snapshot "s + temporary_path_);
+    }
+    std::filesystem::rename(temporary_path_, path_);
+    finished_ = true;
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!finished_) {
+        out_.close();
+        std::error_code ignored;
+        std::filesystem::remove(temporary_path_, ignored);
+    }
+}
+
+void SnapshotWriter::Write(const void* data, size_t size) {
+    static const char padding[8] = {};
+    const size_t aligned_size = AlignedSize(size);
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    out_.write(padding, static_cast<std::streamsize>(aligned_size - size));
+    checksum_ = UpdateChecksum(checksum_, static_cast<const char*>(data), size);
+    size_ += aligned_size;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open snapshot "s + path);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Cannot open snapshot "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map snapshot "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+SnapshotReader::SnapshotReader(const MappedFile& file, bool verify_checksum)
+        : data_(file.data()), size_(file.size()), offset_(sizeof(SnapshotHeader)) {
+    SnapshotHeader header;
+    if (size_ < sizeof(header)) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    std::memcpy(&header, data_, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::runtime_error("Not a snapshot file"s);
+    }
+    if (header.byte_order == FOREIGN_BYTE_ORDER_MARK) {
+        throw std::runtime_error("Snapshot was written with another byte order"s);
+    }
+    if (header.byte_order != BYTE_ORDER_MARK || header.version != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Unsupported snapshot version"s);
+    }
+    if (header.size != size_ || size_ % 8 != 0) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    if (verify_checksum && UpdateChecksum(CHECKSUM_SEED, data_ + offset_, size_ - offset_) != header.checksum) {
+        throw std::runtime_error("Snapshot checksum mismatch"s);
+    }
+}
+
+std::vector<std::string_view> SnapshotReader::ReadStrings() {
+    const auto offsets = ReadArray<uint64_t>();
+    const auto chars = ReadArray<char>();
+    if (offsets.empty() || offsets.back() != chars.size()) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    std::vector<std::string_view> strings;
+    strings.reserve(offsets.size() - 1);
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+        strings.emplace_back(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+bool SnapshotReader::AtEnd() const {
+    return offset_ == size_;
+}
+
+const char* SnapshotReader::Take(size_t size) {
+    if (size > size_ - offset_ || AlignedSize(size) > size_ - offset_) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    const char* data = data_ + offset_;
+    offset_ += AlignedSize(size);
+    return data;
+}
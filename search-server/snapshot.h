@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Файл снимка: заголовок, а за ним последовательность значений и массивов, каждый выровнен по 8 байт.
+// Порядок полей задают те, кто пишет и читает, поэтому при его изменении меняется SNAPSHOT_VERSION.
+// Числа хранятся в порядке байт машины, которая писала файл; чужой порядок распознаётся по заголовку.
+// Версия 2 не хранит хеш-таблицу слов и дерево id документов: OpenSnapshot строит их заново
+// за O(слов + документов). Хранение их плоскими массивами для поиска прямо в файле потребует новой версии
+inline constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+// Пишет во временный файл рядом с path и подменяет им path только в Finish, поэтому
+// процессы, которые держат старый снимок отображённым, продолжают его читать
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Удаляет временный файл, если Finish не был вызван
+    ~SnapshotWriter();
+
+    template<typename T>
+    void WriteValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Write(&value, sizeof(T));
+    }
+
+    // Длина, затем элементы подряд
+    template<typename T>
+    void WriteArray(std::span<const T> values) {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+        WriteValue<uint64_t>(values.size());
+        Write(values.data(), values.size_bytes());
+    }
+
+    // Набор строк одним блоком: смещения начал и общий массив символов
+    void WriteStrings(const std::vector<std::string_view>& strings);
+
+    // Дописывает заголовок с размером и контрольной суммой; без этого вызова файл не откроется
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream out_;
+    bool finished_ = false;
+    uint64_t size_ = 0;
+    uint64_t checksum_;
+
+    void Write(const void* data, size_t size);
+};
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Читает снимок прямо из отображения: массивы возвращаются как span на его память, без копирования
+class SnapshotReader {
+public:
+    // Проверка контрольной суммы читает весь файл, без неё проверяются только заголовок и границы массивов.
+    // Значения внутри массивов проверяют те, кто их читает
+    SnapshotReader(const MappedFile& file, bool verify_checksum);
+
+    template<typename T>
+    T ReadValue() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    std::span<const T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+        const auto count = ReadValue<uint64_t>();
+        if (count > (size_ - offset_) / sizeof(T)) {
+            throw std::runtime_error("Snapshot is corrupted");
+        }
+        return {reinterpret_cast<const T*>(Take(count * sizeof(T))), static_cast<size_t>(count)};
+    }
+
+    std::vector<std::string_view> ReadStrings();
+
+    bool AtEnd() const;
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t offset_;
+
+    const char* Take(size_t size);
+};
@@ -1,4 +1,12 @@
 #include "test_example_functions.h"
+#include "concurrent_search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "sharded_search_server.h"
+
+#include <filesystem>
+#include <sstream>
+#include <thread>
 
 void AssertImpl(bool value, const string &expr_str, const string &file, const string &func, unsigned line,
                 const string &hint) {
@@ -13,6 +21,29 @@ void AssertImpl(bool value, const string &expr_str, const string &file, const st
     }
 }
 
+// Словарь синтетических корпусов: слов мало, так что запросы из них находят много документов
+const vector<string> TEST_CORPUS_WORDS = {"белый"s, "кот"s, "модный"s, "ошейник"s, "пушистый"s, "хвост"s, "пёс"s,
+                                          "выразительные"s, "глаза"s, "скворец"s, "евгений"s, "ухоженный"s};
+
+// Текст документа id из word_count слов TEST_CORPUS_WORDS; слова выбираются по id, так что частоты слов разные
+string MakeTestDocumentText(int id, int word_count) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        text += TEST_CORPUS_WORDS[(id * 31 + i * i * 7 + i) % TEST_CORPUS_WORDS.size()] + " "s;
+    }
+    return text;
+}
+
+// Выдачи совпадают по документам, их порядку и релевантности до последнего бита
+void AssertSameDocuments(const vector<Document>& founded, const vector<Document>& expected, const string& hint) {
+    ASSERT_EQUAL_HINT(founded.size(), expected.size(), hint);
+    for (size_t i = 0; i < founded.size(); ++i) {
+        ASSERT_EQUAL_HINT(founded[i].id, expected[i].id, hint);
+        ASSERT_EQUAL_HINT(founded[i].relevance, expected[i].relevance, hint);
+        ASSERT_EQUAL_HINT(founded[i].rating, expected[i].rating, hint);
+    }
+}
+
 void TestExcludeStopWordsFromAddedDocumentContent() {
     const int doc_id = 42;
     const string content = "cat in the city"s;
@@ -109,6 +140,80 @@ void TestMatchedDocuments() {
         auto [founding_vector, founding_Document_Status] = founding;
         ASSERT_EQUAL(matched_vector, founding_vector);
     }
+
+    // Параллельная версия заменяет несовпавшие слова пустыми и убирает их, не теряя первого совпавшего слова
+    {
+        SearchServer server = SearchServer(" "s);
+        server.AddDocument(doc_id, content, DocumentStatus::ACTUAL, ratings);
+        ASSERT_EQUAL(get<0>(server.MatchDocument(execution::par, "ddd a ccc b", doc_id)),
+                     (vector<string_view>{"a", "b", "ccc", "ddd"}));
+        ASSERT_EQUAL(get<0>(server.MatchDocument(execution::par, "g b i m", doc_id)), vector<string_view>{"b"});
+        ASSERT(get<0>(server.MatchDocument(execution::par, "g i m", doc_id)).empty());
+        ASSERT(get<0>(server.MatchDocument(execution::par, "-g", doc_id)).empty());
+    }
+}
+
+void TestMatchDocumentPolicies() {
+    vector<string> texts;
+    for (int id = 0; id < 300; ++id) {
+        texts.push_back(MakeTestDocumentText(id, id % 8 + 1));
+    }
+    SearchServer server("и в"s);
+    vector<NewDocument> documents;
+    for (int id = 0; id < 150; ++id) {
+        documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {1}});
+    }
+    server.AddDocuments(execution::par, documents);
+    for (int id = 150; id < 300; ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::BANNED, {1});
+    }
+    server.RemoveDocument(3);
+
+    // Слова, которые совпадут все, повторы, слова не из индекса и запрос из одних минус-слов
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "кот кот жираф белый"s, "-пёс"s,
+                                    "евгений скворец глаза пёс белый модный хвост"s};
+    for (const int id : server) {
+        const auto& word_freqs = server.GetWordFrequencies(id);
+        for (const string& query : queries) {
+            const auto expected = server.MatchDocument(query, id);
+            ASSERT(server.MatchDocument(execution::seq, query, id) == expected);
+            ASSERT(server.MatchDocument(execution::par, query, id) == expected);
+            ASSERT(server.MatchDocument(adaptive_execution, query, id) == expected);
+            for (const string_view word : get<0>(expected)) {
+                ASSERT(word_freqs.count(word) > 0);
+            }
+        }
+        const string& word = TEST_CORPUS_WORDS[id % TEST_CORPUS_WORDS.size()];
+        const auto [matched_words, status] = server.MatchDocument(execution::par, word, id);
+        ASSERT_EQUAL(matched_words.size(), word_freqs.count(word));
+    }
+
+    // Пакетная проверка совпадает с MatchDocument для каждого документа, повторы id допустимы
+    vector<int> ids(server.begin(), server.end());
+    ids.push_back(0);
+    for (const string& query : queries) {
+        const auto seq_matched = server.MatchDocuments(query, ids);
+        const auto par_matched = server.MatchDocuments(execution::par, query, ids);
+        const auto adaptive_matched = server.MatchDocuments(adaptive_execution, query, ids);
+        ASSERT_EQUAL(seq_matched.size(), ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const auto expected = server.MatchDocument(query, ids[i]);
+            ASSERT(seq_matched[i] == expected);
+            ASSERT(par_matched[i] == expected);
+            ASSERT(adaptive_matched[i] == expected);
+        }
+    }
+    ASSERT(server.MatchDocuments("кот"s, {}).empty());
+    try {
+        server.MatchDocuments("кот"s, vector<int>{0, 3});
+        ASSERT_HINT(false, "MatchDocuments must throw for a removed document"s);
+    } catch (const out_of_range&) {
+    }
+    try {
+        server.MatchDocuments(execution::par, "кот --пёс"s, vector<int>{0});
+        ASSERT_HINT(false, "MatchDocuments must throw for an invalid query"s);
+    } catch (const invalid_argument&) {
+    }
 }
 
 void TestSort() {
@@ -168,6 +273,39 @@ void TestSort() {
 
 }
 
+void TestScoreAccumulator() {
+    SearchServer server("и"s);
+    // Релевантности первых двух документов различаются меньше чем на RELEVANCE_ERROR_RATE,
+    // поэтому выше должен оказаться документ с большим рейтингом, хотя его релевантность чуть меньше
+    string filler;
+    for (int i = 0; i < 1999; ++i) {
+        filler += " слово"s + to_string(i);
+    }
+    server.AddDocument(0, "кот"s + filler, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(1, "кот"s + filler + " хвост"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(2, "пёс и хвост"s, DocumentStatus::ACTUAL, {3});
+
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        // Повторный запрос берёт из пула уже использованный массив очков, который должен быть очищен
+        for (const auto& founded : {server.FindTopDocuments("кот"s), server.FindTopDocuments(execution::par, "кот"s)}) {
+            ASSERT_EQUAL(founded.size(), 2u);
+            ASSERT(founded[1].relevance > founded[0].relevance);
+            ASSERT(founded[1].relevance - founded[0].relevance < RELEVANCE_ERROR_RATE);
+            ASSERT_EQUAL(founded[0].id, 1);
+            ASSERT_EQUAL(founded[1].id, 0);
+        }
+        ASSERT_EQUAL(server.FindTopDocuments(execution::par, "кот -хвост"s).size(), 1u);
+    }
+
+    // Предикат вызывается один раз на документ, сколько бы слов запроса в нём ни нашлось
+    int predicate_calls = 0;
+    server.FindTopDocuments("кот хвост слово1 слово2"s, [&predicate_calls](int, DocumentStatus, int) {
+        ++predicate_calls;
+        return true;
+    });
+    ASSERT_EQUAL(predicate_calls, 3);
+}
+
 void TestRating() {
     const string Hint = "Рейтинг вычисляется не правильно";
     {
@@ -329,6 +467,21 @@ void TestIDF_TF() {
         ASSERT_EQUAL(founded.at(2).relevance, 0.18310204811135161);
 
     }
+
+    {
+        // IDF кэшируется и должен пересчитываться после добавления и удаления документов
+        SearchServer server("и"s);
+        server.AddDocument(0, "белый кот"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(1, "пушистый кот"s, DocumentStatus::ACTUAL, {2});
+        ASSERT_EQUAL(server.FindTopDocuments("кот"s).at(0).relevance, 0.0);
+
+        server.AddDocument(2, "ухоженный пёс"s, DocumentStatus::ACTUAL, {3});
+        ASSERT_EQUAL(server.FindTopDocuments("кот"s).at(0).relevance, log(3.0 / 2) * 0.5);
+
+        server.RemoveDocument(2);
+        ASSERT_EQUAL(server.FindTopDocuments("кот"s).at(0).relevance, 0.0);
+    }
+
     {
         const string content = " "s;
         SearchServer server = SearchServer(content);
@@ -417,15 +570,1300 @@ void TestDocumentCount() {
 
 }
 
+void TestTermDictionary() {
+    {
+        PostingList postings;
+        for (const uint32_t document_index : {5u, 1u, 9u, 3u}) {
+            postings.Add(document_index, 0.25);
+        }
+        postings.Add(3, 0.5);
+        vector<uint32_t> document_indexes;
+        vector<double> term_freqs;
+        for (auto block = postings.Blocks(); !block.AtEnd(); block.Next()) {
+            document_indexes.insert(document_indexes.end(), block.DocumentIndexes(),
+                                    block.DocumentIndexes() + block.size());
+            term_freqs.insert(term_freqs.end(), block.TermFreqs(), block.TermFreqs() + block.size());
+        }
+        ASSERT_EQUAL(document_indexes, (vector<uint32_t>{1, 3, 5, 9}));
+        ASSERT_EQUAL(term_freqs, (vector<double>{0.25, 0.75, 0.25, 0.25}));
+        ASSERT(postings.Remove(5));
+        ASSERT(!postings.Remove(5));
+        ASSERT(!postings.Contains(5));
+        ASSERT_EQUAL(postings.size(), 3u);
+    }
+    {
+        SearchServer server("и в"s);
+        server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {1});
+        const char* const stored_word = server.GetWordFrequencies(0).find("кот"sv)->first.data();
+        // Слово хранится один раз, и пополнение словаря не портит ссылки на него
+        for (int id = 1; id <= 2000; ++id) {
+            server.AddDocument(id, "кот слово"s + to_string(id), DocumentStatus::ACTUAL, {1});
+        }
+        ASSERT_EQUAL(server.GetWordFrequencies(0).find("кот"sv)->first.data(), stored_word);
+        ASSERT_EQUAL(server.GetWordFrequencies(2000).find("кот"sv)->first.data(), stored_word);
+
+        // Документ из одних стоп-слов получает пустой набор слов и удаляется без ошибок
+        server.AddDocument(5000, "и в"s, DocumentStatus::ACTUAL, {1});
+        ASSERT(server.GetWordFrequencies(5000).empty());
+        server.RemoveDocument(5000);
+        server.RemoveDocument(0);
+        ASSERT(server.FindTopDocuments("модный"s).empty());
+        ASSERT_EQUAL(server.FindTopDocuments("кот"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+        ASSERT_EQUAL(server.GetDocumentCount(), 2000);
+    }
+}
+
+void TestCompressedPostings() {
+    {
+        // Каждое ядро распаковки, которое поддерживает процессор, сверяется с исходными числами
+        uint32_t seed = 12345;
+        for (uint32_t bit_width = 0; bit_width <= 32; ++bit_width) {
+            for (const size_t count : {size_t{1}, size_t{37}, size_t{127}, POSTING_BLOCK_SIZE}) {
+                vector<uint32_t> values(count);
+                for (uint32_t& value : values) {
+                    seed = seed * 1103515245 + 12345;
+                    value = bit_width == 0 ? 0 : (seed ^ (seed << 7)) >> (32 - bit_width);
+                }
+                vector<uint32_t> packed(PackedBlockWords(count, bit_width) + POSTING_BLOCK_PADDING);
+                PackBlock(values.data(), count, bit_width, packed.data());
+                for (const UnpackKernel kernel : {UnpackKernel::SCALAR, UnpackKernel::SSE2, UnpackKernel::AVX2}) {
+                    if (!IsUnpackKernelSupported(kernel)) {
+                        continue;
+                    }
+                    vector<uint32_t> unpacked(POSTING_BLOCK_SIZE);
+                    UnpackBlock(kernel, packed.data(), count, bit_width, unpacked.data());
+                    unpacked.resize(count);
+                    ASSERT_EQUAL_HINT(unpacked, values, "kernel "s + to_string(static_cast<int>(kernel))
+                                                        + ", bit width "s + to_string(bit_width));
+                }
+            }
+        }
+    }
+    {
+        PostingList postings;
+        vector<uint32_t> document_indexes;
+        uint32_t document_index = 0;
+        for (int i = 0; i < 1000; ++i) {
+            // Разрывы разной ширины, вплоть до 32 бит
+            document_index += i % 97 == 0 ? (1u << (i % 31)) : 1 + i % 5;
+            document_indexes.push_back(document_index);
+            postings.Add(document_index, 1.0 / (1 + i % 7));
+        }
+        postings.Compress();
+        ASSERT(postings.IsCompressed());
+        ASSERT_EQUAL(postings.size(), document_indexes.size());
+
+        size_t i = 0;
+        for (auto block = postings.Blocks(); !block.AtEnd(); block.Next()) {
+            for (size_t j = 0; j < block.size(); ++j, ++i) {
+                ASSERT_EQUAL(block.DocumentIndexes()[j], document_indexes[i]);
+                ASSERT(abs(block.TermFreqs()[j] - 1.0 / (1 + i % 7)) < 1e-5);
+            }
+        }
+        ASSERT_EQUAL(i, document_indexes.size());
+
+        ASSERT(postings.Contains(document_indexes[500]));
+        ASSERT(!postings.Contains(document_indexes[500] + 1));
+        ASSERT(postings.Remove(document_indexes[500]));
+        ASSERT(!postings.Contains(document_indexes[500]));
+        postings.Add(document_indexes.back() + 1, 0.5);
+        ASSERT(postings.Contains(document_indexes.back() + 1));
+        ASSERT_EQUAL(postings.size(), document_indexes.size());
+    }
+    {
+        SearchServer server("и в на"s);
+        SearchServer compressed_server("и в на"s);
+        compressed_server.SetPostingsCompression(true);
+        const vector<string> documents = {
+                "белый кот и модный ошейник"s, "пушистый кот пушистый хвост"s,
+                "ухоженный пёс выразительные глаза"s, "ухоженный скворец евгений"s,
+                "кот в сапогах"s, "пёс на сене"s,
+        };
+        for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+            server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id});
+            compressed_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, {id});
+        }
+        server.RemoveDocument(4);
+        compressed_server.RemoveDocument(4);
+
+        const auto expected = server.FindTopDocuments("пушистый ухоженный кот -сене"s);
+        const auto founded = compressed_server.FindTopDocuments(execution::par, "пушистый ухоженный кот -сене"s);
+        ASSERT_EQUAL(founded.size(), expected.size());
+        for (size_t i = 0; i < founded.size(); ++i) {
+            ASSERT_EQUAL(founded[i].id, expected[i].id);
+            ASSERT(abs(founded[i].relevance - expected[i].relevance) < 1e-4);
+        }
+        const string query = "пушистый кот -ошейник"s;
+        const auto [words, status] = compressed_server.MatchDocument(query, 1);
+        ASSERT_EQUAL(words, (vector<string_view>{"кот"sv, "пушистый"sv}));
+    }
+}
+
+void TestTopCount() {
+    SearchServer server("и"s);
+    for (int id = 0; id < 20000; ++id) {
+        server.AddDocument(id, MakeTestDocumentText(id, id % 5 + 1), DocumentStatus::ACTUAL, {id % 113});
+    }
+
+    const auto all = server.FindTopDocuments("кот пушистый хвост"s, DocumentStatus::ACTUAL, 100000);
+    for (size_t i = 1; i < all.size(); ++i) {
+        ASSERT(!IsMoreRelevant(all[i], all[i - 1]));
+    }
+    for (size_t top_count : {0, 1, 5, 37}) {
+        const auto seq = server.FindTopDocuments("кот пушистый хвост"s, DocumentStatus::ACTUAL, top_count);
+        const auto par = server.FindTopDocuments(execution::par, "кот пушистый хвост"s, DocumentStatus::ACTUAL, top_count);
+        const vector<Document> expected(all.begin(), all.begin() + static_cast<ptrdiff_t>(top_count));
+        AssertSameDocuments(seq, expected, "top "s + to_string(top_count));
+        AssertSameDocuments(par, expected, "top "s + to_string(top_count));
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("кот"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+}
+
+void TestMaxScoreRetrieval() {
+    SearchServer server("и в"s);
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, MakeTestDocumentText(id, id % 9 + 1), static_cast<DocumentStatus>(id % 3),
+                           {id % 101 - 50});
+    }
+
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "евгений скворец глаза пёс белый"s,
+                                    "хвост хвост модный -глаза -пёс"s, "ухоженный выразительные кот пушистый скворец белый"s};
+    const auto predicate = [](int, DocumentStatus status, int rating) {
+        return status != DocumentStatus::BANNED && rating > -20;
+    };
+    for (bool compressed : {false, true}) {
+        server.SetPostingsCompression(compressed);
+        for (RetrievalMode mode : {RetrievalMode::MAX_SCORE, RetrievalMode::BLOCK_MAX_SCORE}) {
+            for (const string& query : queries) {
+                for (size_t top_count : {1, 5, 50}) {
+                    server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+                    const auto expected = server.FindTopDocuments(query, predicate, top_count);
+                    server.SetRetrievalMode(mode);
+                    AssertSameDocuments(server.FindTopDocuments(query, predicate, top_count), expected, query);
+                }
+            }
+        }
+    }
+
+    // Частое слово само не выводит документ в выдачу, поэтому после заполнения выдачи проверяются
+    // только документы с редким словом. Предикат вызывается лишь для непрошедших отсечение кандидатов
+    SearchServer zipf_server(""s);
+    for (int id = 0; id < 10000; ++id) {
+        string document = (id % 10 == 0 ? "слово"s : "частое слово"s) + to_string(id % 50);
+        if (id % 20 == 0) {
+            document += " редкое"s;
+        }
+        zipf_server.AddDocument(id, document, DocumentStatus::ACTUAL, {id % 7});
+    }
+    map<RetrievalMode, int> predicate_calls;
+    vector<Document> expected;
+    for (RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::MAX_SCORE, RetrievalMode::BLOCK_MAX_SCORE}) {
+        zipf_server.SetRetrievalMode(mode);
+        const auto founded = zipf_server.FindTopDocuments("частое редкое"s, [&](int, DocumentStatus, int) {
+            ++predicate_calls[mode];
+            return true;
+        });
+        if (mode == RetrievalMode::EXHAUSTIVE) {
+            expected = founded;
+        }
+        AssertSameDocuments(founded, expected, "частое редкое"s);
+    }
+    ASSERT_EQUAL(predicate_calls[RetrievalMode::EXHAUSTIVE], 9500);
+    ASSERT(predicate_calls[RetrievalMode::MAX_SCORE] * 10 < predicate_calls[RetrievalMode::EXHAUSTIVE]);
+    ASSERT(predicate_calls[RetrievalMode::BLOCK_MAX_SCORE] <= predicate_calls[RetrievalMode::MAX_SCORE]);
+}
+
+void TestParallelSplit() {
+    SearchServer server("и в"s);
+    server.SetSegmentCapacity(700);
+    // Документов хватает на несколько диапазонов, а их границы не совпадают с границами сегментов
+    for (int id = 0; id < 7000; ++id) {
+        server.AddDocument(id, MakeTestDocumentText(id, id % 9 + 1), static_cast<DocumentStatus>(id % 3),
+                           {id % 101 - 50});
+    }
+    for (int id = 0; id < 7000; id += 11) {
+        server.RemoveDocument(id);
+    }
+
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "евгений скворец глаза пёс белый"s,
+                                    "хвост хвост модный -глаза -пёс"s};
+    const auto predicate = [](int, DocumentStatus status, int rating) {
+        return status != DocumentStatus::BANNED && rating > -20;
+    };
+    for (bool compressed : {false, true}) {
+        server.SetPostingsCompression(compressed);
+        for (const string& query : queries) {
+            for (size_t top_count : {1, 5, 50}) {
+                const auto expected = server.FindTopDocuments(query, predicate, top_count);
+                server.SetParallelSplit(ParallelSplit::BY_DOCUMENT_RANGE);
+                const auto by_range = server.FindTopDocuments(execution::par, query, predicate, top_count);
+                server.SetParallelSplit(ParallelSplit::BY_TERM);
+                const auto by_term = server.FindTopDocuments(execution::par, query, predicate, top_count);
+                AssertSameDocuments(by_range, expected, query);
+                // По термам очки документа складываются в другом порядке
+                ASSERT_EQUAL_HINT(by_term.size(), expected.size(), query);
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    ASSERT_HINT(abs(by_term[i].relevance - expected[i].relevance) < RELEVANCE_ERROR_RATE, query);
+                }
+            }
+        }
+    }
+}
+
+void TestAdaptivePolicy() {
+    ASSERT(GetAdaptiveThresholds().min_task_work > 0);
+    ASSERT_EQUAL(ChooseParallelism(0, 8), 1u);
+    ASSERT_EQUAL(ChooseParallelism(SIZE_MAX, 1), 1u);
+    ASSERT_EQUAL(ChooseParallelism(SIZE_MAX, 8), 8u);
+    ASSERT_EQUAL(ChooseParallelism(GetAdaptiveThresholds().min_task_work * 3, 8), 3u);
+
+    // Какое бы выполнение ни было выбрано, выдача та же, что у последовательного
+    SearchServer server("и в"s);
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, MakeTestDocumentText(id, 3), static_cast<DocumentStatus>(id % 2), {id % 13});
+    }
+    const auto predicate = [](int, DocumentStatus, int rating) {
+        return rating > 3;
+    };
+    const auto assert_same_as_sequential = [&server, &predicate]() {
+        for (const string& query : {"кот"s, "пушистый кот -ошейник"s, "белый пёс хвост -модный"s, "жираф"s}) {
+            AssertSameDocuments(server.FindTopDocuments(adaptive_execution, query, predicate, 20),
+                                server.FindTopDocuments(query, predicate, 20), query);
+            AssertSameDocuments(server.FindTopDocuments(adaptive_execution, query, DocumentStatus::IRRELEVANT),
+                                server.FindTopDocuments(query, DocumentStatus::IRRELEVANT), query);
+            AssertSameDocuments(server.FindTopDocuments(adaptive_execution, query), server.FindTopDocuments(query),
+                                query);
+            for (const int id : {7, 8}) {
+                ASSERT(server.MatchDocument(adaptive_execution, query, id) == server.MatchDocument(query, id));
+            }
+        }
+    };
+    assert_same_as_sequential();
+
+    // С executor пороги замеряются на нём, а выдача та же
+    WorkStealingExecutor executor(2);
+    ASSERT(CalibrateAdaptiveThresholds(&executor).min_task_work > 0);
+    server.SetExecutor(make_shared<WorkStealingExecutor>(2));
+    assert_same_as_sequential();
+}
+
+void TestQueryCache() {
+    SearchServer server("и в"s);
+    server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+    server.SetQueryCacheCapacity(100);
+
+    const auto expected = server.FindTopDocuments("пушистый кот -ошейник"s);
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 1u);
+    ASSERT_EQUAL(server.GetQueryCacheStats().hits, 0u);
+
+    // Перестановка слов, стоп-слова и слова не из индекса дают тот же ключ
+    const auto cached = server.FindTopDocuments("кот и пушистый -ошейник -жираф"s);
+    ASSERT_EQUAL(server.GetQueryCacheStats().hits, 1u);
+    ASSERT_EQUAL(cached.size(), expected.size());
+    for (size_t i = 0; i < cached.size(); ++i) {
+        ASSERT_EQUAL(cached[i].id, expected[i].id);
+    }
+
+    // Другой статус и другой размер выдачи — другие ключи, предикаты не кэшируются
+    ASSERT_EQUAL(server.FindTopDocuments("ухоженный пёс"s, DocumentStatus::BANNED).size(), 1u);
+    server.FindTopDocuments("пушистый кот -ошейник"s, DocumentStatus::ACTUAL, 1);
+    server.FindTopDocuments("пушистый кот -ошейник"s, [](int, DocumentStatus, int) { return true; });
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 3u);
+    ASSERT_EQUAL(server.GetQueryCacheStats().hits, 1u);
+
+    // Новый документ меняет поколение индекса, и старая выдача не используется
+    server.AddDocument(3, "пушистый кот"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.FindTopDocuments("пушистый кот -ошейник"s).size(), 2u);
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 4u);
+    server.RemoveDocument(3);
+    ASSERT_EQUAL(server.FindTopDocuments("пушистый кот -ошейник"s).size(), 1u);
+    ASSERT_EQUAL(server.GetQueryCacheStats().misses, 5u);
+
+    // Сжатые списки хранят TF с округлением, поэтому смена сжатия тоже сбрасывает выдачу
+    const auto uncached = [&server](const string& query) {
+        return server.FindTopDocuments(query, [](int, DocumentStatus status, int) {
+            return status == DocumentStatus::ACTUAL;
+        });
+    };
+    const string query = "белый пушистый кот"s;
+    for (bool compressed : {true, false}) {
+        server.FindTopDocuments(query);
+        server.SetPostingsCompression(compressed);
+        AssertSameDocuments(server.FindTopDocuments(query), uncached(query), query);
+    }
+
+    SearchServer small_server("и"s);
+    small_server.AddDocument(0, "белый кот"s, DocumentStatus::ACTUAL, {1});
+    small_server.SetQueryCacheCapacity(1);
+    small_server.FindTopDocuments("белый"s);
+    small_server.FindTopDocuments("кот"s);
+    small_server.FindTopDocuments("белый"s);
+    ASSERT_EQUAL(small_server.GetQueryCacheStats().hits, 0u);
+    small_server.FindTopDocuments("белый"s);
+    ASSERT_EQUAL(small_server.GetQueryCacheStats().hits, 1u);
+}
+
+void TestAddDocuments() {
+    // Среди документов есть пустые и со стоп-словом
+    vector<string> texts;
+    for (int id = 0; id < 500; ++id) {
+        texts.push_back(MakeTestDocumentText(id, id % 11) + (id % 4 == 0 ? "и"s : ""s));
+    }
+    vector<NewDocument> documents;
+    for (int id = 0; id < 500; ++id) {
+        documents.push_back({id * 2, texts[id], static_cast<DocumentStatus>(id % 3), {id % 13, -id % 7}});
+    }
+
+    SearchServer expected("и"s);
+    expected.AddDocument(1, "модный пёс"s, DocumentStatus::ACTUAL, {5});
+    for (const NewDocument& document : documents) {
+        expected.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    SearchServer seq_server("и"s);
+    seq_server.AddDocument(1, "модный пёс"s, DocumentStatus::ACTUAL, {5});
+    seq_server.AddDocuments(documents);
+    SearchServer par_server("и"s);
+    par_server.AddDocument(1, "модный пёс"s, DocumentStatus::ACTUAL, {5});
+    par_server.AddDocuments(execution::par, documents);
+
+    for (const SearchServer* server : {&seq_server, &par_server}) {
+        ASSERT_EQUAL(server->GetDocumentCount(), expected.GetDocumentCount());
+        for (const NewDocument& document : documents) {
+            ASSERT(server->GetWordFrequencies(document.id) == expected.GetWordFrequencies(document.id));
+        }
+        for (const string& query : {"кот"s, "пушистый кот -ошейник"s, "евгений скворец глаза пёс белый модный"s}) {
+            AssertSameDocuments(server->FindTopDocuments(query, DocumentStatus::ACTUAL, 50),
+                                expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 50), query);
+        }
+    }
+
+    // Ошибка в любом документе пакета не оставляет в индексе ни одного документа из него
+    const vector<NewDocument> bad_ids = {{2000, "кот", DocumentStatus::ACTUAL, {}},
+                                         {2000, "пёс", DocumentStatus::ACTUAL, {}}};
+    const vector<NewDocument> bad_words = {{2000, "кот", DocumentStatus::ACTUAL, {}},
+                                           {2001, "пё\x12с", DocumentStatus::ACTUAL, {}}};
+    for (const auto* batch : {&bad_ids, &bad_words}) {
+        try {
+            par_server.AddDocuments(execution::par, *batch);
+            ASSERT_HINT(false, "AddDocuments must throw"s);
+        } catch (const invalid_argument&) {
+        }
+        ASSERT_EQUAL(par_server.GetDocumentCount(), expected.GetDocumentCount());
+    }
+}
+
+void TestSnapshot() {
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "евгений скворец глаза пёс белый модный"s};
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+
+    const auto assert_same_index = [&queries](const SearchServer& lhs, const SearchServer& rhs) {
+        ASSERT_EQUAL(lhs.GetDocumentCount(), rhs.GetDocumentCount());
+        for (const string& query : queries) {
+            AssertSameDocuments(rhs.FindTopDocuments(query, DocumentStatus::ACTUAL, 50),
+                                lhs.FindTopDocuments(query, DocumentStatus::ACTUAL, 50), query);
+        }
+    };
+
+    for (bool compressed : {false, true}) {
+        SearchServer server("и в"s);
+        for (int id = 0; id < 1000; ++id) {
+            server.AddDocument(id, MakeTestDocumentText(id, id % 9 + 1), static_cast<DocumentStatus>(id % 3),
+                               {id % 101 - 50});
+        }
+        server.RemoveDocument(10);
+        server.SetPostingsCompression(compressed);
+        server.SaveSnapshot(path);
+
+        SearchServer opened = SearchServer::OpenSnapshot(path);
+        assert_same_index(server, opened);
+        for (const int id : server) {
+            ASSERT(opened.GetWordFrequencies(id) == server.GetWordFrequencies(id));
+        }
+        for (const int id : server) {
+            for (const string& query : queries) {
+                ASSERT(opened.MatchDocument(query, id) == server.MatchDocument(query, id));
+            }
+        }
+
+        // Открытый снимок меняется так же, как исходный индекс, и снова сохраняется
+        for (SearchServer* target : {&server, &opened}) {
+            target->RemoveDocument(7);
+            target->RemoveDocument(500);
+            target->AddDocument(7, "пушистый ухоженный жираф"s, DocumentStatus::ACTUAL, {3});
+            target->AddDocument(2000, "модный белый кот"s, DocumentStatus::ACTUAL, {1});
+        }
+        assert_same_index(server, opened);
+        for (const int id : {7, 2000, 5}) {
+            ASSERT(opened.MatchDocument("пушистый жираф кот"s, id) == server.MatchDocument("пушистый жираф кот"s, id));
+        }
+        opened.SaveSnapshot(path);
+        assert_same_index(server, SearchServer::OpenSnapshot(path));
+    }
+
+    // Повреждённый файл не открывается
+    {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekp(100);
+        file.put('\x7f');
+    }
+    try {
+        SearchServer::OpenSnapshot(path);
+        ASSERT_HINT(false, "OpenSnapshot must reject a corrupted file"s);
+    } catch (const runtime_error&) {
+    }
+
+    // Без проверки контрольной суммы индексы документов и id термов всё равно проверяются на границы.
+    // Снимок из одного документа с одним словом, смещения считаются от конца файла: id терма в прямом индексе,
+    // индекс документа в таблице id и индекс документа в списке вхождений
+    for (const size_t offset_from_end : {16, 56, 168}) {
+        SearchServer server(""s);
+        server.AddDocument(1, "кот"s, DocumentStatus::ACTUAL, {1});
+        server.SaveSnapshot(path);
+        ASSERT_EQUAL(SearchServer::OpenSnapshot(path, false).GetDocumentCount(), 1);
+        {
+            fstream file(path, ios::in | ios::out | ios::binary);
+            file.seekp(-static_cast<streamoff>(offset_from_end), ios::end);
+            const uint32_t corrupted = 5;
+            file.write(reinterpret_cast<const char*>(&corrupted), sizeof(corrupted));
+        }
+        try {
+            SearchServer::OpenSnapshot(path, false);
+            ASSERT_HINT(false, "OpenSnapshot must reject an out of range index at "s + to_string(offset_from_end));
+        } catch (const runtime_error&) {
+        }
+    }
+    filesystem::remove(path);
+}
+
+void TestSegments() {
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "евгений скворец глаза пёс белый модный"s,
+                                    "хвост хвост модный -глаза -пёс"s};
+    vector<string> texts;
+    for (int id = 0; id < 2000; ++id) {
+        texts.push_back(MakeTestDocumentText(id, id % 9 + 1));
+    }
+    vector<NewDocument> batch;
+    for (int id = 1500; id < 2000; ++id) {
+        batch.push_back({id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 101 - 50}});
+    }
+
+    // Один сегмент на всё против мелких сегментов со слияниями; удаления идут вперемешку с добавлением
+    SearchServer expected("и в"s);
+    expected.SetSegmentCapacity(100000);
+    SearchServer server("и в"s);
+    server.SetSegmentCapacity(16);
+    for (SearchServer* target : {&expected, &server}) {
+        for (int id = 0; id < 1500; ++id) {
+            target->AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 101 - 50});
+            if (id % 5 == 4) {
+                target->RemoveDocument(id - 3);
+            }
+        }
+        target->AddDocuments(batch);
+        for (int id = 1000; id < 1400; ++id) {
+            if (id % 5 != 1) {
+                target->RemoveDocument(id);
+            }
+        }
+    }
+    ASSERT_EQUAL(expected.GetSegmentCount(), 1u);
+    ASSERT(server.GetSegmentCount() > 2);
+    server.WaitForMerges();
+
+    const auto predicate = [](int, DocumentStatus status, int rating) {
+        return status != DocumentStatus::BANNED && rating > -20;
+    };
+    for (RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::MAX_SCORE, RetrievalMode::BLOCK_MAX_SCORE}) {
+        server.SetRetrievalMode(mode);
+        for (const string& query : queries) {
+            AssertSameDocuments(server.FindTopDocuments(query, predicate, 50),
+                                expected.FindTopDocuments(query, predicate, 50), query);
+            AssertSameDocuments(server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 20),
+                                expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 20), query);
+        }
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+    for (const int id : expected) {
+        ASSERT(server.GetWordFrequencies(id) == expected.GetWordFrequencies(id));
+        ASSERT(server.MatchDocument(queries[1], id) == expected.MatchDocument(queries[1], id));
+    }
+
+    // Сжимаются запечатанные сегменты, включая только что запечатанный изменяемый.
+    // В снимок сегменты сливаются в один
+    server.SetPostingsCompression(true);
+    expected.SetPostingsCompression(true);
+    const string path = (filesystem::temp_directory_path() / "search_server_segments_test.snapshot"s).string();
+    server.SaveSnapshot(path);
+    const SearchServer opened = SearchServer::OpenSnapshot(path);
+    filesystem::remove(path);
+    for (const string& query : queries) {
+        AssertSameDocuments(server.FindTopDocuments(query, predicate, 50),
+                            expected.FindTopDocuments(query, predicate, 50), query);
+        AssertSameDocuments(opened.FindTopDocuments(query, predicate, 50),
+                            expected.FindTopDocuments(query, predicate, 50), query);
+    }
+}
+
+void TestConcurrentSearchServer() {
+    ConcurrentSearchServer server("и в"s);
+    // Обычный сервер с теми же изменениями
+    SearchServer expected("и в"s);
+    server.AddDocument(0, "белый кот"s, DocumentStatus::ACTUAL, {1});
+    expected.AddDocument(0, "белый кот"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.GetDocumentCount(), 1);
+    ASSERT_EQUAL(server.FindTopDocuments("кот"s).size(), 1u);
+
+    // Документы добавляются и удаляются парами за одну запись, поэтому читатель всегда видит чётное их число
+    // (плюс первый) и обе половины пары вместе
+    atomic<bool> done = false;
+    vector<thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&server, &done]() {
+            while (!done) {
+                const auto access = server.Read();
+                const int document_count = access->GetDocumentCount();
+                ASSERT_EQUAL(document_count % 2, 1);
+                const auto found = access->FindTopDocuments("пушистый хвост"s, DocumentStatus::ACTUAL, 1000);
+                ASSERT_EQUAL(found.size(), static_cast<size_t>(document_count - 1));
+            }
+        });
+    }
+    for (int id = 1; id < 400; id += 2) {
+        const auto add_pair = [id](SearchServer& target) {
+            const string text = MakeTestDocumentText(id, 2) + "пушистый хвост"s;
+            target.AddDocument(id, text, DocumentStatus::ACTUAL, {id});
+            target.AddDocument(id + 1, text, DocumentStatus::ACTUAL, {id});
+        };
+        server.Write(add_pair);
+        add_pair(expected);
+        if (id % 3 == 0) {
+            const auto remove_pair = [id](SearchServer& target) {
+                target.RemoveDocument(id);
+                target.RemoveDocument(id + 1);
+            };
+            server.Write(remove_pair);
+            remove_pair(expected);
+        }
+    }
+    done = true;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    for (const string& query : {"кот"s, "пушистый хвост -пёс"s, "евгений скворец глаза"s}) {
+        AssertSameDocuments(server.FindTopDocuments(query, DocumentStatus::ACTUAL, 50),
+                            expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 50), query);
+    }
+
+    // Отклонённая запись не публикуется, и копии не расходятся
+    try {
+        server.AddDocument(1, "пёс"s, DocumentStatus::ACTUAL, {});
+        ASSERT_HINT(false, "AddDocument must throw"s);
+    } catch (const invalid_argument&) {
+    }
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQUAL(server.GetDocumentCount(), 1 + 2 * 200 - 2 * 67);
+        server.Write([](SearchServer&) {});
+    }
+}
+
+void TestShardedSearchServer() {
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "евгений скворец глаза пёс белый модный"s,
+                                    "хвост хвост модный -глаза -пёс"s};
+    vector<string> texts;
+    for (int id = 0; id < 1000; ++id) {
+        texts.push_back(MakeTestDocumentText(id, id % 7 + 1));
+    }
+    vector<NewDocument> batch;
+    for (int id = 600; id < 1000; ++id) {
+        batch.push_back({id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 89 - 40}});
+    }
+
+    // IDF в частях считается по всему корпусу, поэтому выдача совпадает с общим индексом до последнего бита
+    SearchServer expected("и в"s);
+    ShardedSearchServer server("и в"s, 4);
+    for (int id = 0; id < 600; ++id) {
+        expected.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 89 - 40});
+        server.AddDocument(id, texts[id], static_cast<DocumentStatus>(id % 3), {id % 89 - 40});
+    }
+    expected.AddDocuments(batch);
+    server.AddDocuments(batch);
+    for (int id = 0; id < 1000; id += 7) {
+        expected.RemoveDocument(id);
+        server.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+
+    const auto predicate = [](int, DocumentStatus status, int rating) {
+        return status != DocumentStatus::BANNED && rating > -20;
+    };
+    server.SetQueryCacheCapacity(16);
+    for (RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::MAX_SCORE}) {
+        server.SetRetrievalMode(mode);
+        expected.SetRetrievalMode(mode);
+        for (const string& query : queries) {
+            AssertSameDocuments(server.FindTopDocuments(query, predicate, 30),
+                                expected.FindTopDocuments(query, predicate, 30), query);
+            AssertSameDocuments(server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED),
+                                expected.FindTopDocuments(execution::par, query, DocumentStatus::BANNED), query);
+            AssertSameDocuments(server.FindTopDocuments(query), expected.FindTopDocuments(query), query);
+        }
+    }
+    for (const int id : expected) {
+        ASSERT(server.GetWordFrequencies(id) == expected.GetWordFrequencies(id));
+        ASSERT(server.MatchDocument(queries[1], id) == expected.MatchDocument(queries[1], id));
+    }
+
+    // Ошибка в одной части откатывает пакет во всех, а кэш частей сбрасывается изменением в любой
+    const string query = "пушистый кот"s;
+    const auto before = server.FindTopDocuments(query);
+    const vector<NewDocument> bad_batch = {{2000, "пушистый кот", DocumentStatus::ACTUAL, {100}},
+                                           {2001, "пушистый кот", DocumentStatus::ACTUAL, {100}},
+                                           {1, "кот", DocumentStatus::ACTUAL, {}}};
+    try {
+        server.AddDocuments(bad_batch);
+        ASSERT_HINT(false, "AddDocuments must throw"s);
+    } catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+    AssertSameDocuments(server.FindTopDocuments(query), before, query);
+    try {
+        server.FindTopDocuments("кот --пёс"s);
+        ASSERT_HINT(false, "FindTopDocuments must throw"s);
+    } catch (const invalid_argument&) {
+    }
+    server.AddDocument(2000, "пушистый кот"s, DocumentStatus::ACTUAL, {100});
+    expected.AddDocument(2000, "пушистый кот"s, DocumentStatus::ACTUAL, {100});
+    AssertSameDocuments(server.FindTopDocuments(query), expected.FindTopDocuments(query), query);
+
+    // После отключения общей статистики IDF, посчитанный по ней, не должен снова стать свежим
+    // через несколько добавлений документов
+    CorpusStatistics statistics;
+    for (const auto& word_freqs : {map<string_view, double>{{"кот"sv, 1.0}}, map<string_view, double>{{"пёс"sv, 1.0}},
+                                   map<string_view, double>{{"кот"sv, 0.5}, {"пёс"sv, 0.5}}}) {
+        statistics.AddDocument(word_freqs);
+    }
+    for (int added_count = 1; added_count < 8; ++added_count) {
+        SearchServer detached("и в"s);
+        SearchServer own("и в"s);
+        detached.AddDocument(0, "кот"s, DocumentStatus::ACTUAL, {1});
+        own.AddDocument(0, "кот"s, DocumentStatus::ACTUAL, {1});
+        detached.SetCorpusStatistics(&statistics);
+        ASSERT_EQUAL(detached.FindTopDocuments("кот"s)[0].relevance, log(3.0 / 2));
+        detached.SetCorpusStatistics(nullptr);
+        for (int id = 1; id <= added_count; ++id) {
+            detached.AddDocument(id, "пёс"s, DocumentStatus::ACTUAL, {1});
+            own.AddDocument(id, "пёс"s, DocumentStatus::ACTUAL, {1});
+        }
+        AssertSameDocuments(detached.FindTopDocuments("кот"s), own.FindTopDocuments("кот"s), "кот"s);
+    }
+
+    // Номер слова переживает его исчезновение из корпуса, так что номер, запомненный индексом, остаётся верным
+    const size_t cat_id = statistics.FindWord("кот"sv);
+    statistics.RemoveDocument({{"кот"sv, 1.0}});
+    statistics.RemoveDocument({{"кот"sv, 0.5}, {"пёс"sv, 0.5}});
+    ASSERT_EQUAL(statistics.GetDocumentFrequency("кот"sv), 0u);
+    statistics.AddDocument({{"кот"sv, 1.0}});
+    ASSERT_EQUAL(statistics.FindWord("кот"sv), cat_id);
+    ASSERT_EQUAL(statistics.GetDocumentFrequency(cat_id), 1u);
+    ASSERT_EQUAL(statistics.FindWord("скворец"sv), CorpusStatistics::NO_WORD);
+}
+
+void TestWorkStealingExecutor() {
+    WorkStealingExecutor executor(3, 4);
+    ASSERT_EQUAL(executor.GetWorkerCount(), 3u);
+
+    // Вложенные ParallelFor: внешний поток и исполнители помогают друг другу, пока ждут
+    vector<atomic<int>> sums(100);
+    executor.ParallelFor(100, [&](size_t i) {
+        executor.ParallelFor(i, [&](size_t j) {
+            sums[i] += static_cast<int>(j);
+        });
+    });
+    for (size_t i = 0; i < sums.size(); ++i) {
+        ASSERT_EQUAL(sums[i].load(), static_cast<int>(i * (i - 1) / 2));
+    }
+
+    // Каждый помощник, кроме первой задачи в вызове, учтён ровно один раз: в очереди или как задача,
+    // выполненная сразу. Лишние помощники могут выполниться уже после возврата ParallelFor
+    WorkStealingExecutor stats_executor(2, 3);
+    stats_executor.ParallelFor(1000, [](size_t) {});
+    uint64_t counted_tasks = 0;
+    while (counted_tasks < 11u) {
+        this_thread::yield();
+        const auto stats = stats_executor.GetStats();
+        counted_tasks = stats.inline_tasks;
+        for (const auto& worker : stats.workers) {
+            ASSERT(worker.stolen_tasks <= worker.executed_tasks);
+            counted_tasks += worker.executed_tasks;
+        }
+    }
+    ASSERT_EQUAL(counted_tasks, 11u);
+
+    // Ожидающий поток не берёт чужих задач: долгая задача из Submit не задерживает ParallelFor
+    {
+        WorkStealingExecutor busy_executor(1);
+        atomic<bool> started = false;
+        atomic<bool> release = false;
+        // Первую задачу берёт исполнитель, вторая ждёт в очереди, и взять её мог бы только ParallelFor
+        for (int i = 0; i < 2; ++i) {
+            busy_executor.Submit([&started, &release]() {
+                started = true;
+                while (!release.load()) {
+                    this_thread::yield();
+                }
+            });
+        }
+        while (!started.load()) {
+            this_thread::yield();
+        }
+        atomic<int> sum = 0;
+        busy_executor.ParallelFor(100, [&sum](size_t i) {
+            sum += static_cast<int>(i);
+        });
+        ASSERT_EQUAL(sum.load(), 4950);
+        release = true;
+    }
+
+    // В очередь нулевой длины не попадает ничего
+    WorkStealingExecutor inline_executor(1, 0);
+    inline_executor.ParallelFor(1000, [](size_t) {});
+    ASSERT_EQUAL(inline_executor.GetStats().inline_tasks, 7u);
+    ASSERT_EQUAL(inline_executor.GetStats().workers[0].executed_tasks, 0u);
+
+    try {
+        executor.ParallelFor(10, [](size_t i) {
+            if (i == 7) {
+                throw out_of_range("7"s);
+            }
+        });
+        ASSERT_HINT(false, "ParallelFor must throw"s);
+    } catch (const out_of_range&) {
+    }
+
+    // Сервер на executor отвечает так же, как на пуле стандартной библиотеки
+    SearchServer server("и в"s);
+    vector<NewDocument> batch;
+    vector<string> texts;
+    for (int id = 0; id < 5000; ++id) {
+        texts.push_back(MakeTestDocumentText(id, 3));
+    }
+    for (int id = 0; id < 5000; ++id) {
+        batch.push_back({id, texts[id], DocumentStatus::ACTUAL, {id % 17}});
+    }
+    server.AddDocuments(execution::par, batch);
+    const vector<string> queries = {"кот"s, "пушистый кот -ошейник"s, "белый пёс хвост"s, "модный"s};
+    const auto expected = ProcessQueries(server, queries);
+    SearchServer executor_server("и в"s);
+    executor_server.SetExecutor(make_shared<WorkStealingExecutor>(2));
+    executor_server.AddDocuments(execution::par, batch);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(executor_server.FindTopDocuments(execution::par, queries[i]), expected[i], queries[i]);
+    }
+    // По термам очки документа складываются в другом порядке, поэтому сравниваются только документы
+    executor_server.SetParallelSplit(ParallelSplit::BY_TERM);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto founded = executor_server.FindTopDocuments(execution::par, queries[i]);
+        ASSERT_EQUAL_HINT(founded.size(), expected[i].size(), queries[i]);
+        for (size_t j = 0; j < founded.size(); ++j) {
+            ASSERT_EQUAL_HINT(founded[j].id, expected[i][j].id, queries[i]);
+        }
+    }
+    executor_server.SetParallelSplit(ParallelSplit::BY_DOCUMENT_RANGE);
+    const auto founded = ProcessQueries(executor_server, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(founded[i], expected[i], queries[i]);
+    }
+}
+
+void TestFindTopDocumentsAsync() {
+    SearchServer server("и в"s);
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, MakeTestDocumentText(id, 3), DocumentStatus::ACTUAL, {id % 13});
+    }
+    const string query = "пушистый кот -ошейник"s;
+    const auto later = chrono::steady_clock::now() + chrono::hours(1);
+    const auto earlier = chrono::steady_clock::now() - chrono::seconds(1);
+
+    for (RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::MAX_SCORE}) {
+        server.SetRetrievalMode(mode);
+        for (bool with_executor : {false, true}) {
+            server.SetExecutor(with_executor ? make_shared<WorkStealingExecutor>(2) : nullptr);
+            const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, 10);
+
+            // Успевший запрос возвращает полную выдачу
+            auto future = server.FindTopDocumentsAsync(query, later, DocumentStatus::ACTUAL, 10);
+            const SearchResult result = future.get();
+            ASSERT(result.complete);
+            AssertSameDocuments(result.documents, expected, query);
+
+            // Просроченный и отменённый запросы прерываются до первого списка
+            const SearchResult expired = server.FindTopDocumentsAsync(query, earlier).get();
+            ASSERT(!expired.complete);
+            ASSERT(expired.documents.empty());
+            stop_source stop;
+            stop.request_stop();
+            const SearchResult cancelled = server.FindTopDocumentsAsync(
+                    query, later, [](int, DocumentStatus, int rating) { return rating > 2; }, 10,
+                    stop.get_token()).get();
+            ASSERT(!cancelled.complete);
+
+            try {
+                server.FindTopDocumentsAsync("кот --пёс"s, later).get();
+                ASSERT_HINT(false, "FindTopDocumentsAsync must throw"s);
+            } catch (const invalid_argument&) {
+            }
+        }
+    }
+
+    // Без executor брошенная future дожидается запроса, поэтому сервер можно удалить сразу после неё
+    {
+        SearchServer temporary("и в"s);
+        for (int id = 0; id < 3000; ++id) {
+            temporary.AddDocument(id, MakeTestDocumentText(id, 2), DocumentStatus::ACTUAL, {1});
+        }
+        for (int i = 0; i < 8; ++i) {
+            temporary.FindTopDocumentsAsync(query, later);
+        }
+    }
+
+    // При заполненной очереди executor запрос не выполняется в вызывающем потоке, а вызов возвращается сразу
+    {
+        auto executor = make_shared<WorkStealingExecutor>(1, 1);
+        server.SetExecutor(executor);
+        atomic<bool> started = false;
+        atomic<bool> release = false;
+        const auto block = [&started, &release]() {
+            started = true;
+            while (!release.load()) {
+                this_thread::yield();
+            }
+        };
+        // Первую задачу берёт исполнитель, вторая занимает единственное место в очереди
+        executor->Submit(block);
+        while (!started.load()) {
+            this_thread::yield();
+        }
+        executor->Submit(block);
+        const thread::id caller = this_thread::get_id();
+        atomic<bool> inline_call = false;
+        auto future = server.FindTopDocumentsAsync(query, later, [&](int, DocumentStatus, int) {
+            inline_call = inline_call || this_thread::get_id() == caller;
+            return true;
+        });
+        const SearchResult result = future.get();
+        ASSERT(!inline_call.load());
+        ASSERT(result.complete);
+        AssertSameDocuments(result.documents, server.FindTopDocuments(query, [](int, DocumentStatus, int) {
+            return true;
+        }), query);
+        release = true;
+        server.SetExecutor(nullptr);
+    }
+}
+
+void TestProcessQueries() {
+    SearchServer server("и в"s);
+    server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+    server.AddDocument(3, "ухоженный скворец евгений"s, DocumentStatus::ACTUAL, {9});
+    const vector<string> queries = {"пушистый кот"s, "жираф"s, "ухоженный -пёс"s, "кот пёс скворец"s};
+
+    const auto by_query = ProcessQueries(server, queries);
+    ASSERT_EQUAL(by_query.size(), queries.size());
+    vector<int> expected_ids;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto expected = server.FindTopDocuments(queries[i]);
+        ASSERT_EQUAL(by_query[i].size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(by_query[i][j].id, expected[j].id);
+            expected_ids.push_back(expected[j].id);
+        }
+    }
+
+    // Объединённая выдача — те же документы подряд, пустые выдачи пропускаются
+    vector<int> joined_ids;
+    for (const Document& document : ProcessQueriesJoined(server, queries)) {
+        joined_ids.push_back(document.id);
+    }
+    ASSERT_EQUAL(joined_ids, expected_ids);
+
+    mutex sink_mutex;
+    vector<vector<Document>> streamed(queries.size());
+    size_t call_count = 0;
+    ProcessQueriesStreaming(server, queries, [&](size_t query, vector<Document> documents) {
+        lock_guard guard(sink_mutex);
+        streamed[query] = std::move(documents);
+        ++call_count;
+    });
+    ASSERT_EQUAL(call_count, queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_EQUAL(streamed[i].size(), by_query[i].size());
+        for (size_t j = 0; j < streamed[i].size(); ++j) {
+            ASSERT_EQUAL(streamed[i][j].id, by_query[i][j].id);
+        }
+    }
+}
+
+void TestFindTopDocumentsBatch() {
+    SearchServer server("и в"s);
+    server.SetSegmentCapacity(300);
+    for (int id = 0; id < 2000; ++id) {
+        server.AddDocument(id, MakeTestDocumentText(id, id % 7 + 1), static_cast<DocumentStatus>(id % 3),
+                           {id % 31 - 15});
+    }
+    for (int id = 0; id < 2000; id += 9) {
+        server.RemoveDocument(id);
+    }
+
+    // Запросов больше одной группы, слова в них повторяются и внутри запроса, и между запросами
+    const auto& words = TEST_CORPUS_WORDS;
+    vector<string> queries;
+    for (int i = 0; i < 150; ++i) {
+        string query = words[i % words.size()] + " "s + words[i * 7 % words.size()] + " "s
+                       + words[i * i % words.size()];
+        if (i % 4 == 0) {
+            query += " -"s + words[(i + 5) % words.size()];
+        }
+        queries.push_back(query);
+    }
+    queries.push_back("жираф"s);
+    queries.push_back("кот кот"s);
+    // Одно слово на разных позициях и повторённое не подряд
+    queries.push_back("кот пёс"s);
+    queries.push_back("пёс хвост кот"s);
+    queries.push_back("кот хвост кот"s);
+
+    // Вклады складываются в порядке id термов, поэтому релевантность совпадает с точностью до округления
+    const auto assert_same_results = [&queries](const vector<vector<Document>>& founded, const auto& find_expected) {
+        ASSERT_EQUAL(founded.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const vector<Document> expected = find_expected(i);
+            ASSERT_EQUAL_HINT(founded[i].size(), expected.size(), queries[i]);
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL_HINT(founded[i][j].id, expected[j].id, queries[i]);
+                ASSERT_HINT(abs(founded[i][j].relevance - expected[j].relevance) < RELEVANCE_ERROR_RATE, queries[i]);
+                ASSERT_EQUAL_HINT(founded[i][j].rating, expected[j].rating, queries[i]);
+            }
+        }
+    };
+    for (DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+        const auto find_expected = [&server, &queries, status](size_t i) {
+            return server.FindTopDocuments(queries[i], status, 7);
+        };
+        assert_same_results(server.FindTopDocumentsBatch(queries, status, 7), find_expected);
+        assert_same_results(server.FindTopDocumentsBatch(execution::seq, queries, status, 7), find_expected);
+        assert_same_results(server.FindTopDocumentsBatch(adaptive_execution, queries, status, 7), find_expected);
+    }
+    const auto predicate = [](int document_id, DocumentStatus, int rating) {
+        return document_id % 2 == 0 && rating > 0;
+    };
+    assert_same_results(server.FindTopDocumentsBatch(queries, predicate, 5), [&](size_t i) {
+        return server.FindTopDocuments(queries[i], predicate, 5);
+    });
+    const auto separate = ProcessQueries(server, queries);
+    assert_same_results(ProcessQueriesBatched(server, queries), [&separate](size_t i) {
+        return separate[i];
+    });
+
+    // У запроса из одного слова складывать нечего, и релевантность совпадает до последнего бита
+    const vector<string> single_word_queries = {"кот"s, "пёс"s, "кот"s};
+    const auto single_word_results = server.FindTopDocumentsBatch(single_word_queries);
+    for (size_t i = 0; i < single_word_queries.size(); ++i) {
+        AssertSameDocuments(single_word_results[i], server.FindTopDocuments(single_word_queries[i]),
+                            single_word_queries[i]);
+    }
+
+    try {
+        server.FindTopDocumentsBatch(vector<string>{"кот"s, "кот --пёс"s});
+        ASSERT_HINT(false, "FindTopDocumentsBatch must throw"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestPreparedQuery() {
+    SearchServer server("и в"s);
+    server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+    server.AddDocument(3, "ухоженный скворец евгений"s, DocumentStatus::ACTUAL, {9});
+
+    // Подготовленный запрос не ссылается на строку, из которой разобран
+    const string raw_query = "пушистый ухоженный кот -ошейник жираф"s;
+    const SearchServer::PreparedQuery query = server.PrepareQuery(string(raw_query));
+    const auto by_status = [](int, DocumentStatus status, int) { return status == DocumentStatus::BANNED; };
+    AssertSameDocuments(server.FindTopDocuments(query), server.FindTopDocuments(raw_query), raw_query);
+    AssertSameDocuments(server.FindTopDocuments(query, DocumentStatus::BANNED),
+                        server.FindTopDocuments(raw_query, DocumentStatus::BANNED), raw_query);
+    AssertSameDocuments(server.FindTopDocuments(query, by_status), server.FindTopDocuments(raw_query, by_status),
+                        raw_query);
+    AssertSameDocuments(server.FindTopDocuments(execution::par, query),
+                        server.FindTopDocuments(execution::par, raw_query), raw_query);
+    AssertSameDocuments(server.FindTopDocuments(adaptive_execution, query, DocumentStatus::ACTUAL, 1),
+                        server.FindTopDocuments(adaptive_execution, raw_query, DocumentStatus::ACTUAL, 1), raw_query);
+
+    // После изменения индекса учитываются и слова, которых при подготовке не было
+    server.AddDocument(4, "жираф жираф кот"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.FindTopDocuments(query).front().id, 4);
+    AssertSameDocuments(server.FindTopDocuments(query), server.FindTopDocuments(raw_query), raw_query);
+    server.RemoveDocument(1);
+    AssertSameDocuments(server.FindTopDocuments(query), server.FindTopDocuments(raw_query), raw_query);
+    server.SetQueryCacheCapacity(10);
+    server.FindTopDocuments(query);
+    AssertSameDocuments(server.FindTopDocuments(query), server.FindTopDocuments(raw_query), raw_query);
+    ASSERT_EQUAL(server.GetQueryCacheStats().hits, 2u);
+
+    // Термы другого сервера не используются
+    SearchServer other_server("и в"s);
+    other_server.AddDocument(7, "ухоженный кот"s, DocumentStatus::ACTUAL, {1});
+    AssertSameDocuments(other_server.FindTopDocuments(query), other_server.FindTopDocuments(raw_query), raw_query);
+
+    try {
+        server.PrepareQuery("кот --пёс"s);
+        ASSERT_HINT(false, "PrepareQuery must throw"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestRemoveDuplicates() {
+    const auto add_documents = [](SearchServer& server) {
+        server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+        // Дубликаты документа 2: те же слова с другой частотой, в другом порядке и со стоп-словами
+        server.AddDocument(3, "funny pet with curly hair curly"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(4, "curly hair and funny pet with"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
+        server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    };
+    const vector<int> expected_ids = {1, 2, 6, 8, 9};
+
+    for (bool parallel : {false, true}) {
+        SearchServer server("and with"s);
+        add_documents(server);
+        ASSERT_EQUAL(server.FindDuplicateDocuments(execution::seq), (vector<int>{3, 4, 5, 7}));
+        ostringstream output;
+        auto* const old_buffer = cout.rdbuf(output.rdbuf());
+        if (parallel) {
+            RemoveDuplicates(execution::par, server);
+        } else {
+            RemoveDuplicates(server);
+        }
+        cout.rdbuf(old_buffer);
+        ASSERT_EQUAL(output.str(), "Found duplicate document id 3\nFound duplicate document id 4\n"
+                                   "Found duplicate document id 5\nFound duplicate document id 7\n"s);
+        ASSERT_EQUAL(vector<int>(server.begin(), server.end()), expected_ids);
+        ASSERT_EQUAL(server.GetDocumentCount(), 5);
+        ASSERT(server.FindDuplicateDocuments(execution::par).empty());
+        ASSERT_EQUAL(server.FindTopDocuments("curly"s).size(), 2u);
+    }
+
+    // Документы снимка сравниваются по его прямому индексу, в том числе с добавленными после открытия
+    const string path = (filesystem::temp_directory_path() / "search_server_duplicates.snapshot"s).string();
+    {
+        SearchServer server("and with"s);
+        add_documents(server);
+        server.SaveSnapshot(path);
+    }
+    SearchServer opened = SearchServer::OpenSnapshot(path);
+    opened.AddDocument(10, "rat nasty pet funny"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(opened.FindDuplicateDocuments(execution::par), (vector<int>{3, 4, 5, 7, 10}));
+    opened.RemoveDocuments(opened.FindDuplicateDocuments(execution::seq));
+    ASSERT_EQUAL(vector<int>(opened.begin(), opened.end()), expected_ids);
+    filesystem::remove(path);
+
+    // Пакетное удаление проверяет все id до изменения индекса
+    SearchServer server("and with"s);
+    add_documents(server);
+    try {
+        server.RemoveDocuments(vector<int>{1, 42});
+        ASSERT_HINT(false, "RemoveDocuments must throw for an unknown id"s);
+    } catch (const out_of_range&) {
+    }
+    try {
+        server.RemoveDocuments(vector<int>{1, 1});
+        ASSERT_HINT(false, "RemoveDocuments must throw for a repeated id"s);
+    } catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 9);
+}
+
+void TestNearDuplicates() {
+    // Шаблонные страницы: у каждой копии заменено одно слово из двадцати, между шаблонами общих слов мало
+    SearchServer server("and with"s);
+    vector<vector<int>> expected_groups;
+    int id = 0;
+    for (int page = 0; page < 20; ++page) {
+        vector<string> words;
+        for (int i = 0; i < 20; ++i) {
+            words.push_back("p"s + to_string(page) + "w"s + to_string(i));
+        }
+        words[0] = "common"s;
+        auto& group = expected_groups.emplace_back();
+        for (int copy = 0; copy < 6; ++copy) {
+            vector<string> copy_words = words;
+            if (copy > 0) {
+                copy_words[copy * 3] = "changed"s + to_string(copy);
+            }
+            string text;
+            for (const string& word : copy_words) {
+                text += word + " and "s;
+            }
+            group.push_back(id);
+            server.AddDocument(id++, text, DocumentStatus::ACTUAL, {1});
+        }
+        // Между копиями шаблона — непохожие документы
+        server.AddDocument(id++, "common unique"s + to_string(page) + " other"s, DocumentStatus::ACTUAL, {1});
+    }
+
+    ASSERT_EQUAL(server.FindNearDuplicateDocuments(execution::seq, 0.8), expected_groups);
+    ASSERT_EQUAL(server.FindNearDuplicateDocuments(execution::par, 0.8), expected_groups);
+    // Порог 1 находит только точные совпадения наборов слов
+    server.AddDocument(id, "p3w1 and p3w2"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(id + 1, "p3w2 p3w1"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.FindNearDuplicateDocuments(execution::par, 1.0), (vector<vector<int>>{{id, id + 1}}));
+    ASSERT_EQUAL(server.FindDuplicateDocuments(execution::par), vector<int>{id + 1});
+
+    for (const double threshold : {0.0, -1.0, 1.5}) {
+        try {
+            server.FindNearDuplicateDocuments(execution::seq, threshold);
+            ASSERT_HINT(false, "FindNearDuplicateDocuments must check the threshold"s);
+        } catch (const invalid_argument&) {
+        }
+    }
+
+    ostringstream output;
+    auto* const old_buffer = cout.rdbuf(output.rdbuf());
+    RemoveNearDuplicates(execution::par, server, 0.8);
+    cout.rdbuf(old_buffer);
+    ASSERT_EQUAL(server.GetDocumentCount(), 20 * 2 + 1);
+    for (const auto& group : expected_groups) {
+        ASSERT_EQUAL(server.GetWordFrequencies(group.front()).size(), 20u);
+        ASSERT(output.str().find("Found near duplicate document id "s + to_string(group.back()) + "\n"s)
+               != string::npos);
+    }
+    ASSERT(server.FindNearDuplicateDocuments(execution::par, 0.8).empty());
+}
+
+void TestDuplicateHandling() {
+    SearchServer server("and with"s);
+    vector<pair<int, int>> reported;
+    const auto handler = [&reported](int document_id, int original_id) {
+        reported.emplace_back(document_id, original_id);
+    };
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7});
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(3, "rat nasty pet funny"s, DocumentStatus::ACTUAL, {1});
+
+    // Включение строит индекс по уже добавленным документам
+    server.SetDuplicateHandling(DuplicateHandling::REJECT, handler);
+    server.AddDocument(4, "nasty rat and funny pet pet"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(5, "funny pet"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.GetDocumentCount(), 4);
+    ASSERT_EQUAL(reported.size(), 1u);
+    ASSERT(reported[0] == pair(4, 1) || reported[0] == pair(4, 3));
+
+    // После удаления обоих оригиналов такой документ снова принимается
+    server.RemoveDocument(1);
+    const vector<int> removed_ids = {3};
+    server.RemoveDocuments(removed_ids);
+    server.AddDocument(4, "nasty rat and funny pet pet"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    ASSERT_EQUAL(reported.size(), 1u);
+
+    // Пакет сравнивается и с индексом, и сам с собой
+    reported.clear();
+    const vector<NewDocument> documents = {
+            {6, "curly hair funny pet", DocumentStatus::ACTUAL, {1}},
+            {7, "brand new words", DocumentStatus::ACTUAL, {1}},
+            {8, "words new brand and", DocumentStatus::ACTUAL, {1}},
+            {9, "another document", DocumentStatus::ACTUAL, {1}},
+    };
+    server.AddDocuments(execution::par, documents);
+    ASSERT(reported == (vector<pair<int, int>>{{6, 2}, {8, 7}}));
+    ASSERT_EQUAL(server.GetDocumentCount(), 5);
+    ASSERT(server.FindDuplicateDocuments(execution::seq).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("words"s).size(), 1u);
+
+    // Ошибка в пакете бросается до вызова обработчика
+    reported.clear();
+    const vector<NewDocument> invalid_documents = {
+            {10, "brand new words", DocumentStatus::ACTUAL, {1}},
+            {11, "bad wo\x12rd", DocumentStatus::ACTUAL, {1}},
+    };
+    try {
+        server.AddDocuments(invalid_documents);
+        ASSERT_HINT(false, "AddDocuments must reject invalid words"s);
+    } catch (const invalid_argument&) {
+    }
+    ASSERT(reported.empty());
+    ASSERT_EQUAL(server.GetDocumentCount(), 5);
+
+    // REPORT добавляет документ, и совпадения с ним тоже находятся
+    server.SetDuplicateHandling(DuplicateHandling::REPORT, handler);
+    server.AddDocument(12, "another document"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.GetDocumentCount(), 6);
+    ASSERT(reported == (vector<pair<int, int>>{{12, 9}}));
+    server.RemoveDocument(9);
+    server.AddDocument(13, "document another"s, DocumentStatus::ACTUAL, {1});
+    ASSERT(reported == (vector<pair<int, int>>{{12, 9}, {13, 12}}));
+
+    // ALLOW не проверяет наборы
+    server.SetDuplicateHandling(DuplicateHandling::ALLOW);
+    server.AddDocument(14, "another document"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(reported.size(), 2u);
+    ASSERT_EQUAL(server.FindDuplicateDocuments(execution::seq), (vector<int>{13, 14}));
+
+    // Документы, открытые из снимка, тоже попадают в индекс
+    const string path = (filesystem::temp_directory_path() / "search_server_duplicate_handling.snapshot"s).string();
+    server.SaveSnapshot(path);
+    {
+        SearchServer opened = SearchServer::OpenSnapshot(path);
+        opened.SetDuplicateHandling(DuplicateHandling::REJECT);
+        opened.AddDocument(15, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(opened.GetDocumentCount(), server.GetDocumentCount());
+        opened.RemoveDocument(2);
+        opened.AddDocument(15, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(opened.GetDocumentCount(), server.GetDocumentCount());
+    }
+    filesystem::remove(path);
+}
+
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestMinusWords);
     RUN_TEST(TestMatchedDocuments);
+    RUN_TEST(TestMatchDocumentPolicies);
     RUN_TEST(TestSort);
+    RUN_TEST(TestScoreAccumulator);
     RUN_TEST(TestRating);
     RUN_TEST(TestPredicate);
     RUN_TEST(TestStatus);
     RUN_TEST(TestIDF_TF);
     RUN_TEST(TestSearch);
     RUN_TEST(TestDocumentCount);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestCompressedPostings);
+    RUN_TEST(TestTopCount);
+    RUN_TEST(TestMaxScoreRetrieval);
+    RUN_TEST(TestParallelSplit);
+    RUN_TEST(TestAdaptivePolicy);
+    RUN_TEST(TestQueryCache);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestSnapshot);
+    RUN_TEST(TestSegments);
+    RUN_TEST(TestConcurrentSearchServer);
+    RUN_TEST(TestShardedSearchServer);
+    RUN_TEST(TestWorkStealingExecutor);
+    RUN_TEST(TestFindTopDocumentsAsync);
+    RUN_TEST(TestProcessQueries);
+    RUN_TEST(TestFindTopDocumentsBatch);
+    RUN_TEST(TestPreparedQuery);
+    RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestNearDuplicates);
+    RUN_TEST(TestDuplicateHandling);
 }
\ No newline at end of file
@@ -89,8 +89,12 @@ void TestMinusWords();
 
 void TestMatchedDocuments();
 
+void TestMatchDocumentPolicies();
+
 void TestSort();
 
+void TestScoreAccumulator();
+
 void TestRating();
 
 void TestPredicate();
@@ -103,4 +107,44 @@ void TestSearch();
 
 void TestDocumentCount();
 
+void TestTermDictionary();
+
+void TestCompressedPostings();
+
+void TestTopCount();
+
+void TestMaxScoreRetrieval();
+
+void TestParallelSplit();
+
+void TestAdaptivePolicy();
+
+void TestQueryCache();
+
+void TestAddDocuments();
+
+void TestSnapshot();
+
+void TestSegments();
+
+void TestConcurrentSearchServer();
+
+void TestShardedSearchServer();
+
+void TestWorkStealingExecutor();
+
+void TestFindTopDocumentsAsync();
+
+void TestProcessQueries();
+
+void TestFindTopDocumentsBatch();
+
+void TestPreparedQuery();
+
+void TestRemoveDuplicates();
+
+void TestNearDuplicates();
+
+void TestDuplicateHandling();
+
 void TestSearchServer();
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <cmath>
+
+#include "top_documents.h"
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_ERROR_RATE) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        // Полные совпадения упорядочены по id, чтобы выдача не зависела от порядка обхода документов
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t top_count)
+        : top_count_(top_count) {
+}
+
+void TopDocuments::Add(const Document& document) {
+    if (heap_.size() < top_count_) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (top_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() >= top_count_;
+}
+
+double TopDocuments::GetThreshold() const {
+    if (!IsFull()) {
+        return -std::numeric_limits<double>::infinity();
+    }
+    if (heap_.empty()) {
+        return std::numeric_limits<double>::infinity();
+    }
+    // Документ в пределах погрешности от худшего может обойти его по рейтингу, поэтому с запасом
+    return heap_.front().relevance - 2 * RELEVANCE_ERROR_RATE;
+}
+
+std::vector<Document> TopDocuments::Build() && {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return std::move(heap_);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <execution>
+#include <limits>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "document.h"
+#include "work_stealing_executor.h"
+
+const int MAX_RESULT_DOCUMENT_COUNT = 5;
+const double RELEVANCE_ERROR_RATE = 1e-6;
+
+// Порядок выдачи: по убыванию релевантности, при равной релевантности — по убыванию рейтинга, затем по id
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Ограниченная куча из top_count лучших документов: наименее релевантный лежит в вершине
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t top_count);
+
+    void Add(const Document& document);
+
+    void Merge(const TopDocuments& other);
+
+    bool IsFull() const;
+
+    // Наименьшая релевантность, с которой документ ещё может попасть в выдачу
+    double GetThreshold() const;
+
+    std::vector<Document> Build() &&;
+
+private:
+    size_t top_count_;
+    std::vector<Document> heap_;
+};
+
+// executor, если задан, выполняет параллельный отбор вместо пула стандартной библиотеки
+template<typename Policy>
+std::vector<Document> SelectTopDocuments(Policy policy, const std::vector<Document>& documents, size_t top_count,
+                                         WorkStealingExecutor* executor = nullptr) {
+    // Меньше такого куска на поток параллелить нет смысла
+    const size_t min_chunk_size = 4096;
+    const size_t thread_count = executor != nullptr ? executor->GetWorkerCount() + 1
+                                                    : std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunk_count = std::min<size_t>(thread_count, documents.size() / min_chunk_size);
+
+    if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>) {
+        TopDocuments top(top_count);
+        for (const Document& document : documents) {
+            top.Add(document);
+        }
+        return std::move(top).Build();
+    } else {
+        if (chunk_count <= 1) {
+            return SelectTopDocuments(std::execution::seq, documents, top_count);
+        }
+        std::vector<TopDocuments> partial(chunk_count, TopDocuments(top_count));
+        ParallelFor(executor, policy, chunk_count, [&documents, &partial, chunk_count](size_t chunk) {
+            const size_t first = documents.size() * chunk / chunk_count;
+            const size_t last = documents.size() * (chunk + 1) / chunk_count;
+            for (size_t i = first; i < last; ++i) {
+                partial[chunk].Add(documents[i]);
+            }
+        });
+        for (size_t i = 1; i < chunk_count; ++i) {
+            partial[0].Merge(partial[i]);
+        }
+        return std::move(partial[0]).Build();
+    }
+}
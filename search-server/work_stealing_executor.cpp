@@ -0,0 +1,195 @@
+#include <exception>
+
+#include "work_stealing_executor.h"
+
+namespace {
+
+// Пул, которому принадлежит текущий поток, и номер потока в нём
+thread_local const WorkStealingExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+bool WorkStealingExecutor::Region::RunTask() {
+    const size_t index = next.fetch_add(1);
+    if (index >= task_count) {
+        return false;
+    }
+    // Пока эта задача не завершена, Run ждёт, так что task ещё жива
+    try {
+        task(index);
+    } catch (...) {
+        std::lock_guard guard(error_mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+    }
+    if (pending.fetch_sub(1) == 1) {
+        pending.notify_all();
+    }
+    return true;
+}
+
+WorkStealingExecutor::WorkStealingExecutor(size_t worker_count, size_t max_queue_depth)
+        : max_queue_depth_(max_queue_depth) {
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_[i]->thread = std::thread([this, i]() {
+            WorkerLoop(i);
+        });
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (const auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+size_t WorkStealingExecutor::GetWorkerCount() const {
+    return workers_.size();
+}
+
+WorkStealingExecutor::Stats WorkStealingExecutor::GetStats() const {
+    Stats stats;
+    for (const auto& worker : workers_) {
+        stats.workers.push_back({worker->executed_tasks.load(), worker->stolen_tasks.load(),
+                                 worker->idle_waits.load()});
+    }
+    stats.inline_tasks = inline_tasks_.load();
+    return stats;
+}
+
+void WorkStealingExecutor::Run(size_t task_count, const std::function<void(size_t)>& task) {
+    const auto region = std::make_shared<Region>(task, task_count);
+    // Помощников на одного меньше, чем задач: хотя бы одну задачу поток выполнит сам.
+    // Если очередь заполнена, оставшиеся задачи тоже достанутся ему
+    for (size_t index = 1; index < task_count; ++index) {
+        if (!Push([region]() {
+            region->RunTask();
+        })) {
+            inline_tasks_.fetch_add(task_count - index, std::memory_order_relaxed);
+            break;
+        }
+    }
+    while (region->RunTask()) {
+    }
+    // Не начатых задач не осталось, а взятые другими потоками уже выполняются: их можно ждать не помогая
+    for (size_t pending = region->pending.load(); pending != 0; pending = region->pending.load()) {
+        region->pending.wait(pending);
+    }
+    if (region->error) {
+        std::rethrow_exception(region->error);
+    }
+}
+
+void WorkStealingExecutor::Submit(std::function<void()> task) {
+    if (!Push(std::move(task))) {
+        inline_tasks_.fetch_add(1, std::memory_order_relaxed);
+        task();
+    }
+}
+
+bool WorkStealingExecutor::TrySubmit(std::function<void()>&& task) {
+    return Push(std::move(task));
+}
+
+bool WorkStealingExecutor::Push(std::function<void()>&& task) {
+    const size_t worker = GetCurrentWorker();
+    {
+        std::mutex& mutex = worker < workers_.size() ? workers_[worker]->mutex : external_mutex_;
+        auto& tasks = worker < workers_.size() ? workers_[worker]->tasks : external_tasks_;
+        std::lock_guard guard(mutex);
+        if (tasks.size() >= max_queue_depth_) {
+            return false;
+        }
+        tasks.push_back(std::move(task));
+    }
+    // Поток, который засыпает, сначала отмечается в sleeping_count_, а потом проверяет queued_task_count_,
+    // поэтому либо он увидит задачу, либо здесь будет виден он сам
+    queued_task_count_.fetch_add(1);
+    if (sleeping_count_.load() != 0) {
+        {
+            std::lock_guard guard(sleep_mutex_);
+        }
+        wake_.notify_one();
+    }
+    return true;
+}
+
+bool WorkStealingExecutor::RunPendingTask(size_t self) {
+    std::function<void()> task;
+    bool stolen = false;
+
+    const auto take = [&task](std::mutex& mutex, std::deque<std::function<void()>>& tasks, bool from_back) {
+        std::lock_guard guard(mutex);
+        if (tasks.empty()) {
+            return false;
+        }
+        if (from_back) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        } else {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        return true;
+    };
+
+    bool found = take(workers_[self]->mutex, workers_[self]->tasks, true);
+    // Чужие очереди обходятся начиная с соседа, чтобы воры не сталкивались на одной
+    for (size_t offset = 1; !found && offset <= workers_.size(); ++offset) {
+        const size_t victim = (self + offset) % workers_.size();
+        if (victim != self) {
+            found = stolen = take(workers_[victim]->mutex, workers_[victim]->tasks, false);
+        }
+    }
+    if (!found) {
+        found = stolen = take(external_mutex_, external_tasks_, false);
+    }
+    if (!found) {
+        return false;
+    }
+
+    queued_task_count_.fetch_sub(1);
+    task();
+    workers_[self]->executed_tasks.fetch_add(1, std::memory_order_relaxed);
+    if (stolen) {
+        workers_[self]->stolen_tasks.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void WorkStealingExecutor::WorkerLoop(size_t worker) {
+    current_executor = this;
+    current_worker = worker;
+    while (true) {
+        if (RunPendingTask(worker)) {
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        if (stopping_) {
+            return;
+        }
+        sleeping_count_.fetch_add(1);
+        if (queued_task_count_.load() == 0) {
+            workers_[worker]->idle_waits.fetch_add(1, std::memory_order_relaxed);
+            wake_.wait(lock, [this]() {
+                return stopping_ || queued_task_count_.load() != 0;
+            });
+        }
+        sleeping_count_.fetch_sub(1);
+    }
+}
+
+size_t WorkStealingExecutor::GetCurrentWorker() const {
+    return current_executor == this ? current_worker : workers_.size();
+}
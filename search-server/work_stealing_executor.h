@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <execution>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Пул потоков с перехватом задач, на котором выполняются и параллельные запросы (ProcessQueries),
+// и параллельные части одного запроса. У каждого потока своя очередь: он берёт задачи с её конца,
+// а простаивающие потоки забирают их с начала чужих очередей. Поток, вызвавший ParallelFor, сам разбирает
+// ещё не начатые задачи своего вызова, а потом спит, пока другие потоки не закончат взятые ими. Чужих задач
+// он не берёт, поэтому не застревает в чужой долгой задаче, а вложенный параллелизм не плодит потоков
+// и не блокируется: ждать приходится только задачи, которые уже выполняются.
+// Очереди ограничены: задача, которой не нашлось места, выполняется сразу в вызывающем потоке
+class WorkStealingExecutor {
+public:
+    struct WorkerStats {
+        // Выполнено задач из очередей, из них забрано из чужих очередей и из общей очереди внешних потоков
+        uint64_t executed_tasks = 0;
+        uint64_t stolen_tasks = 0;
+        // Сколько раз поток засыпал без работы
+        uint64_t idle_waits = 0;
+    };
+
+    struct Stats {
+        std::vector<WorkerStats> workers;
+        // Задачи, выполненные сразу, потому что очередь была заполнена
+        uint64_t inline_tasks = 0;
+    };
+
+    static constexpr size_t DEFAULT_MAX_QUEUE_DEPTH = 256;
+
+    // Вызывающий ParallelFor поток тоже выполняет задачи, так что извне пул загружает до worker_count + 1 ядер
+    explicit WorkStealingExecutor(size_t worker_count = std::max(1u, std::thread::hardware_concurrency()),
+                                  size_t max_queue_depth = DEFAULT_MAX_QUEUE_DEPTH);
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    ~WorkStealingExecutor();
+
+    size_t GetWorkerCount() const;
+
+    // Выполняет body(i) для всех i из [0, count) и возвращается, когда все вызовы завершены.
+    // Первое исключение из body бросается дальше после завершения остальных вызовов
+    template<typename Body>
+    void ParallelFor(size_t count, Body body);
+
+    // Ставит задачу в очередь и не ждёт её. Задача, которой не нашлось места, выполняется сразу в вызывающем потоке.
+    // Перед разрушением пул выполняет все поставленные задачи
+    void Submit(std::function<void()> task);
+
+    // Как Submit, но задачу, которой не нашлось места, не выполняет: возвращает false, и task остаётся у вызывающего
+    bool TrySubmit(std::function<void()>&& task);
+
+    Stats GetStats() const;
+
+private:
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::atomic<uint64_t> executed_tasks = 0;
+        std::atomic<uint64_t> stolen_tasks = 0;
+        std::atomic<uint64_t> idle_waits = 0;
+        std::thread thread;
+    };
+
+    // Задачей на каждого исполнителя больше, чтобы неравные куски выравнивались перехватом
+    static constexpr size_t TASKS_PER_THREAD = 4;
+
+    size_t max_queue_depth_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Очередь задач от потоков не из пула
+    std::mutex external_mutex_;
+    std::deque<std::function<void()>> external_tasks_;
+    std::atomic<uint64_t> inline_tasks_ = 0;
+
+    // Задачи во всех очередях; по нему спящие потоки узнают о работе
+    std::atomic<size_t> queued_task_count_ = 0;
+    std::atomic<size_t> sleeping_count_ = 0;
+    std::atomic<bool> stopping_ = false;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+
+    // Один вызов Run. В очереди ставятся помощники, каждый берёт следующую не начатую задачу вызова;
+    // помощник, которому задач не осталось, ничего не делает, поэтому может пережить сам вызов
+    struct Region {
+        Region(const std::function<void(size_t)>& task, size_t task_count)
+                : task(task), task_count(task_count), pending(task_count) {
+        }
+
+        // false, если не начатых задач не осталось
+        bool RunTask();
+
+        const std::function<void(size_t)>& task;
+        const size_t task_count;
+        std::atomic<size_t> next = 0;
+        // Не завершённые задачи; обнуление будит ждущий Run
+        std::atomic<size_t> pending;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    // Выполняет task(0), ..., task(task_count - 1) с ожиданием, как ParallelFor
+    void Run(size_t task_count, const std::function<void(size_t)>& task);
+
+    // false, если очередь текущего потока заполнена; тогда task остаётся у вызывающего
+    bool Push(std::function<void()>&& task);
+
+    // Выполняет одну задачу: из очереди потока self, из чужой или из общей. false, если задач нет
+    bool RunPendingTask(size_t self);
+
+    void WorkerLoop(size_t worker);
+
+    // Номер текущего потока в этом пуле или workers_.size() для потока не из пула
+    size_t GetCurrentWorker() const;
+};
+
+template<typename Body>
+void WorkStealingExecutor::ParallelFor(size_t count, Body body) {
+    const size_t task_count = std::min(count, (workers_.size() + 1) * TASKS_PER_THREAD);
+    if (task_count == 0) {
+        return;
+    }
+    Run(task_count, [count, task_count, &body](size_t task) {
+        const size_t last = count * (task + 1) / task_count;
+        for (size_t i = count * task / task_count; i < last; ++i) {
+            body(i);
+        }
+    });
+}
+
+// body(i) для i из [0, count): на executor, если он задан, иначе через std::for_each с policy
+template<typename Policy, typename Body>
+void ParallelFor(WorkStealingExecutor* executor, Policy policy, size_t count, Body body) {
+    if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+    } else if (executor != nullptr) {
+        executor->ParallelFor(count, body);
+    } else {
+        std::vector<size_t> indexes(count);
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(policy, indexes.begin(), indexes.end(), body);
+    }
+}